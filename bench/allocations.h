@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+namespace cpparg::bench {
+
+/* Number of global operator new calls since the start of the program */
+size_t allocations_count();
+
+} // namespace cpparg::bench
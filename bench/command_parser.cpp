@@ -0,0 +1,74 @@
+#include "args_builder.h"
+
+#include <cpparg/cpparg.h>
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+static void command_dispatch(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i) {
+        names.push_back("command-" + std::to_string(i));
+    }
+
+    cpparg::command_parser parser("bench");
+    for (size_t i = 0; i < count; ++i) {
+        parser.command(names[i]).description("Some command").handle([i](int, const char*[]) {
+            return static_cast<int>(i);
+        });
+    }
+
+    cpparg::test::args_builder builder("./bench");
+    builder.add(names[count / 2]).add("--some", "args");
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow));
+    }
+}
+BENCHMARK(command_dispatch)->RangeMultiplier(10)->Range(10, 1000);
+
+static void command_help(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    cpparg::command_parser parser("bench");
+    for (size_t i = 0; i < count; ++i) {
+        parser.command("command-" + std::to_string(i)).description("Some command");
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.help_message_impl());
+    }
+}
+BENCHMARK(command_help)->RangeMultiplier(10)->Range(10, 1000);
+
+/* "bench db shard-N rebalance" through a three-level command tree */
+static void command_tree_dispatch(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i) {
+        names.push_back("shard-" + std::to_string(i));
+    }
+
+    cpparg::command_parser parser("bench");
+    auto& db = parser.command("db");
+    for (size_t i = 0; i < count; ++i) {
+        db.command(names[i]).command("rebalance").handle([i](int, const char*[]) {
+            return static_cast<int>(i);
+        });
+    }
+
+    cpparg::test::args_builder builder("./bench");
+    builder.add("db").add(names[count / 2]).add("rebalance").add("--some", "args");
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow));
+    }
+}
+BENCHMARK(command_tree_dispatch)->RangeMultiplier(10)->Range(10, 1000);
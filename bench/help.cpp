@@ -0,0 +1,18 @@
+#include "schema.h"
+
+#include <cpparg/cpparg.h>
+
+#include <benchmark/benchmark.h>
+
+static void help_message(benchmark::State& state) {
+    cpparg::bench::schema schema(static_cast<size_t>(state.range(0)));
+    cpparg::parser parser("bench");
+    schema.fill(parser);
+    parser.add_help('h', "help");
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.help_message_impl());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * schema.size()));
+}
+BENCHMARK(help_message)->RangeMultiplier(10)->Range(10, 10000);
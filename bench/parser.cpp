@@ -0,0 +1,401 @@
+#include "allocations.h"
+#include "args_builder.h"
+#include "schema.h"
+
+#include <cpparg/cpparg.h>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* Every registered option is present in argv */
+static void parse_all_options(benchmark::State& state) {
+    cpparg::bench::schema schema(static_cast<size_t>(state.range(0)));
+    cpparg::parser parser("bench");
+    schema.fill(parser);
+
+    cpparg::test::args_builder builder("./bench");
+    for (size_t i = 0; i < schema.size(); ++i) {
+        builder.add(schema.key(i), "42");
+    }
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+        benchmark::DoNotOptimize(schema.values().data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * schema.size()));
+}
+BENCHMARK(parse_all_options)->RangeMultiplier(10)->Range(10, 10000);
+
+/* Few options are present, the rest get their default values */
+static void parse_few_options(benchmark::State& state) {
+    cpparg::bench::schema schema(static_cast<size_t>(state.range(0)));
+    cpparg::parser parser("bench");
+    schema.fill(parser);
+
+    cpparg::test::args_builder builder("./bench");
+    builder.add(schema.key(0), "42").add(schema.key(schema.size() - 1), "42");
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+        benchmark::DoNotOptimize(schema.values().data());
+    }
+}
+BENCHMARK(parse_few_options)->RangeMultiplier(10)->Range(10, 10000);
+
+/* Every option given by an abbreviation: one failed hash lookup and one binary search each */
+static void parse_abbreviated_options(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    std::vector<std::string> names;
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < count; ++i) {
+        names.push_back("option-" + std::to_string(i) + "-value");
+        keys.push_back("--option-" + std::to_string(i) + "-v");
+    }
+
+    cpparg::parser parser("bench");
+    std::vector<int> values(count);
+    for (size_t i = 0; i < count; ++i) {
+        parser.add(names[i]).store(values[i]);
+    }
+
+    cpparg::test::args_builder builder("./bench");
+    for (const auto& key : keys) {
+        builder.add(key, "42");
+    }
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(parse_abbreviated_options)->RangeMultiplier(10)->Range(10, 10000)->Arg(2000);
+
+/* One repeatable option given many times */
+static void parse_long_argv(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    cpparg::parser parser("bench");
+    std::vector<int> values;
+    parser.add('i', "int").repeatable().append(values);
+
+    cpparg::test::args_builder builder("./bench");
+    for (size_t i = 0; i < count; ++i) {
+        builder.add("-i", "123456");
+    }
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        values.clear();
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(parse_long_argv)->RangeMultiplier(10)->Range(1000, 100000);
+
+/* Repeated option and free arguments into empty containers, with and without the prescan */
+static void parse_cold_containers(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    cpparg::parser parser("bench");
+    parser.prescan(state.range(1) != 0);
+    std::vector<int> values;
+    std::vector<int> free_values;
+    parser.add('i', "int").repeatable().append(values);
+    parser.free_arguments("ints").unlimited().store(free_values);
+
+    cpparg::test::args_builder builder("./bench");
+    for (size_t i = 0; i < count; ++i) {
+        builder.add("-i", "123456").add("654321");
+    }
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        std::vector<int>().swap(values);
+        std::vector<int>().swap(free_values);
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(parse_cold_containers)->ArgsProduct({{1000, 100000}, {0, 1}});
+
+/* One --ids argument with a long comma-separated list; the second argument is the thread count */
+static void parse_list(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    std::string list;
+    for (size_t i = 0; i < count; ++i) {
+        list += std::to_string(1000000 + i * 37) + ',';
+    }
+    list.pop_back();
+
+    cpparg::parser parser("bench");
+    std::vector<int64_t> ids;
+    parser.add("ids").store_list(ids, ',', static_cast<size_t>(state.range(1)));
+
+    cpparg::test::args_builder builder("./bench");
+    auto [argc, argv] = builder.add("--ids", list).get();
+
+    for (auto _ : state) {
+        ids.clear();
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+        benchmark::DoNotOptimize(ids.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * list.size()));
+}
+BENCHMARK(parse_list)->ArgsProduct({{1000, 1000000}, {1, 4}})->Unit(benchmark::kMicrosecond);
+
+/* Bundled flags, attached values, --name=value and negative numbers, as wrappers generate them */
+static void parse_option_forms(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    cpparg::parser parser("bench");
+    std::vector<int> values;
+    bool a = false;
+    bool b = false;
+    parser.add('a').repeatable().flag(a);
+    parser.add('b').repeatable().flag(b);
+    parser.add('i', "int").repeatable().append(values);
+
+    cpparg::test::args_builder builder("./bench");
+    for (size_t i = 0; i < count; i += 3) {
+        builder.add("-abi123456").add("--int=-123456").add("--int", "-42");
+    }
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        values.clear();
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(parse_option_forms)->RangeMultiplier(10)->Range(1000, 100000);
+
+static void parse_free_arguments(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+
+    cpparg::parser parser("bench");
+    std::vector<int> values;
+    parser.free_arguments("ints").unlimited().store(values);
+
+    cpparg::test::args_builder builder("./bench");
+    for (size_t i = 0; i < count; ++i) {
+        builder.add("123456");
+    }
+    auto [argc, argv] = builder.get();
+
+    for (auto _ : state) {
+        values.clear();
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(parse_free_arguments)->RangeMultiplier(10)->Range(1000, 100000);
+
+static void construct_parser(benchmark::State& state) {
+    cpparg::bench::schema schema(static_cast<size_t>(state.range(0)));
+
+    const size_t allocations_before = cpparg::bench::allocations_count();
+    for (auto _ : state) {
+        cpparg::parser parser("bench");
+        schema.fill(parser);
+        benchmark::DoNotOptimize(&parser);
+    }
+    const size_t allocations = cpparg::bench::allocations_count() - allocations_before;
+    state.counters["allocations"] = static_cast<double>(allocations) / state.iterations();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * schema.size()));
+}
+BENCHMARK(construct_parser)->RangeMultiplier(10)->Range(10, 10000);
+
+static void construct_parser_handlers(benchmark::State& state) {
+    cpparg::bench::schema schema(static_cast<size_t>(state.range(0)));
+    auto& values = schema.values();
+
+    int sum = 0;
+    int calls = 0;
+    for (auto _ : state) {
+        cpparg::parser parser("bench");
+        for (size_t i = 0; i < schema.size(); ++i) {
+            parser.add(schema.name(i)).handle<int>([&values, &sum, &calls, i](int v) {
+                values[i] = v;
+                sum += v;
+                ++calls;
+            });
+        }
+        benchmark::DoNotOptimize(&parser);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * schema.size()));
+}
+BENCHMARK(construct_parser_handlers)->Arg(1000);
+
+/* Many short command lines through one compiled parser; the argument is the number of threads */
+static void parse_many(benchmark::State& state) {
+    static constexpr size_t INPUTS = 100000;
+
+    cpparg::bench::schema schema(10);
+    cpparg::parser parser("bench");
+    schema.fill(parser);
+    const cpparg::compiled_parser compiled = parser.compile();
+
+    std::vector<cpparg::command_line> inputs(INPUTS);
+    for (size_t i = 0; i < INPUTS; ++i) {
+        inputs[i].split(cpparg::util::join("./bench ", schema.key(i % 10), ' ', i));
+    }
+
+    std::vector<int> outputs;
+    const std::string_view name = schema.name(0);
+    for (auto _ : state) {
+        auto results = compiled.parse_many(
+            inputs,
+            outputs,
+            [name](const cpparg::compiled_parser::arguments& args, int& out) {
+                out = *args.get<int>(name);
+            },
+            static_cast<size_t>(state.range(0)));
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * INPUTS));
+}
+BENCHMARK(parse_many)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+/*
+ * Every option is present but only three are read; the argument is 0 for a validating
+ * compiled parser and 1 for one that converts on access through handles
+ */
+static void parse_inspect_few(benchmark::State& state) {
+    cpparg::bench::schema schema(300);
+    cpparg::parser parser("bench");
+    schema.fill(parser);
+    const cpparg::compiled_parser compiled = parser.compile(state.range(0) == 0);
+
+    cpparg::test::args_builder builder("./bench");
+    for (size_t i = 0; i < schema.size(); ++i) {
+        builder.add(schema.key(i), "42");
+    }
+    auto [argc, argv] = builder.get();
+
+    const std::array<cpparg::compiled_parser::handle, 3> handles{
+        compiled.option_handle(schema.name(0)),
+        compiled.option_handle(schema.name(150)),
+        compiled.option_handle(schema.name(299))};
+    cpparg::compiled_parser::arguments args;
+    for (auto _ : state) {
+        compiled.try_parse(argc, argv, args);
+        int sum = 0;
+        for (const auto& handle : handles) {
+            sum += *args.get<int>(handle);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+}
+BENCHMARK(parse_inspect_few)->Arg(0)->Arg(1);
+
+/* One completion query as done by a fresh process: register the options, build the index, answer */
+static void complete_options(benchmark::State& state) {
+    cpparg::bench::schema schema(static_cast<size_t>(state.range(0)));
+    const std::vector<std::string_view> words{"--option1"};
+
+    for (auto _ : state) {
+        cpparg::parser parser("bench");
+        schema.fill(parser);
+        std::stringstream out;
+        parser.complete(words, out);
+        benchmark::DoNotOptimize(out.str().data());
+    }
+}
+BENCHMARK(complete_options)->RangeMultiplier(10)->Range(10, 10000)->Unit(benchmark::kMicrosecond);
+
+/* Message for a mistyped option: one bounded edit distance per long name */
+static void suggest_option(benchmark::State& state) {
+    cpparg::bench::schema schema(static_cast<size_t>(state.range(0)));
+    cpparg::parser parser("bench");
+    schema.fill(parser);
+
+    std::string typo = schema.key(schema.size() / 2);
+    std::swap(typo[3], typo[4]);
+    cpparg::test::args_builder builder("./bench");
+    auto [argc, argv] = builder.add(typo).get();
+
+    for (auto _ : state) {
+        auto result = parser.try_parse(argc, argv);
+        std::string message = result.message();
+        benchmark::DoNotOptimize(message.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * schema.size()));
+}
+BENCHMARK(suggest_option)->Arg(50)->Arg(500)->Arg(5000)->Unit(benchmark::kMicrosecond);
+
+namespace {
+
+struct service_config {
+    int port = 80;
+    int threads = 1;
+    int64_t memory_limit = 0;
+    double ratio = 0.5;
+    std::string host;
+    std::string log_path;
+    bool verbose = false;
+    std::vector<int> shards;
+};
+
+const char* SERVICE_ARGS[] = {
+    "./bench", "--port", "8080", "--threads", "16", "--memory-limit", "1073741824",
+    "--ratio", "0.75", "--host", "example.com", "--log-path", "/var/log/service.log",
+    "--verbose", "--shard", "1", "--shard", "2", "--shard", "3", nullptr};
+
+} // namespace
+
+/* A service config through a struct_parser: one table of offsets and converters */
+static void parse_struct(benchmark::State& state) {
+    const cpparg::struct_parser parser{
+        cpparg::field(&service_config::port, "port"),
+        cpparg::field(&service_config::threads, "threads"),
+        cpparg::field(&service_config::memory_limit, "memory-limit"),
+        cpparg::field(&service_config::ratio, "ratio"),
+        cpparg::field(&service_config::host, "host"),
+        cpparg::field(&service_config::log_path, "log-path"),
+        cpparg::field(&service_config::verbose, "verbose"),
+        cpparg::field(&service_config::shards, "shard"),
+    };
+
+    service_config config;
+    for (auto _ : state) {
+        config.shards.clear();
+        parser.try_parse(std::size(SERVICE_ARGS) - 1, SERVICE_ARGS, config);
+        benchmark::DoNotOptimize(config.shards.data());
+    }
+}
+BENCHMARK(parse_struct);
+
+/* The same config through a parser with one store() handler per member */
+static void parse_struct_with_handlers(benchmark::State& state) {
+    service_config config;
+    cpparg::parser parser("bench");
+    parser.add("port").store(config.port);
+    parser.add("threads").store(config.threads);
+    parser.add("memory-limit").store(config.memory_limit);
+    parser.add("ratio").store(config.ratio);
+    parser.add("host").store(config.host);
+    parser.add("log-path").store(config.log_path);
+    parser.add("verbose").flag(config.verbose);
+    parser.add("shard").repeatable().append(config.shards);
+
+    for (auto _ : state) {
+        parser.try_reparse(std::size(SERVICE_ARGS) - 1, SERVICE_ARGS);
+        benchmark::DoNotOptimize(config.shards.data());
+    }
+}
+BENCHMARK(parse_struct_with_handlers);
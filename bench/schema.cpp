@@ -0,0 +1,39 @@
+#include "schema.h"
+
+namespace cpparg::bench {
+
+schema::schema(size_t count)
+    : values_(count) {
+    for (size_t i = 0; i < count; ++i) {
+        names_.push_back("option-" + std::to_string(i));
+        keys_.push_back("--" + names_.back());
+    }
+}
+
+size_t schema::size() const {
+    return names_.size();
+}
+
+const std::string& schema::name(size_t i) const {
+    return names_[i];
+}
+
+const std::string& schema::key(size_t i) const {
+    return keys_[i];
+}
+
+void schema::fill(cpparg::parser& parser) {
+    for (size_t i = 0; i < size(); ++i) {
+        parser.add(names_[i])
+            .store(values_[i])
+            .value_type("INTEGER")
+            .default_value(i)
+            .description("Some integer option with a long enough description");
+    }
+}
+
+std::vector<int>& schema::values() {
+    return values_;
+}
+
+} // namespace cpparg::bench
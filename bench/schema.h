@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cpparg/cpparg.h>
+
+#include <string>
+#include <vector>
+
+namespace cpparg::bench {
+
+/* Generated option set; owns the names, so views kept by parsers and argv stay valid */
+class schema {
+public:
+    schema(size_t count);
+
+    size_t size() const;
+
+    const std::string& name(size_t i) const;
+    /* "--name" */
+    const std::string& key(size_t i) const;
+
+    /* Registers every option as an integer stored into values() */
+    void fill(cpparg::parser& parser);
+
+    std::vector<int>& values();
+
+private:
+    std::vector<std::string> names_;
+    std::vector<std::string> keys_;
+    std::vector<int> values_;
+};
+
+} // namespace cpparg::bench
@@ -0,0 +1,100 @@
+#include <cpparg/cpparg.h>
+
+#include <benchmark/benchmark.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+
+struct point {
+    int x;
+    int y;
+};
+
+std::istream& operator>>(std::istream& is, point& p) {
+    return is >> p.x >> p.y;
+}
+
+std::ostream& operator<<(std::ostream& os, const point& p) {
+    return os << p.x << ' ' << p.y;
+}
+
+} // namespace
+
+namespace {
+
+template<typename T>
+void run_from_string(benchmark::State& state, std::string_view input) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(input);
+        benchmark::DoNotOptimize(cpparg::util::from_string<T>(input));
+    }
+}
+
+template<typename T>
+void run_to_string(benchmark::State& state, const T& value) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cpparg::util::to_string(value));
+    }
+}
+
+} // namespace
+
+static void from_string_int(benchmark::State& state) {
+    run_from_string<int>(state, "-123456");
+}
+BENCHMARK(from_string_int);
+
+static void from_string_size_t(benchmark::State& state) {
+    run_from_string<size_t>(state, "18446744073709551615");
+}
+BENCHMARK(from_string_size_t);
+
+static void from_string_double(benchmark::State& state) {
+    run_from_string<double>(state, "3.14159265358979");
+}
+BENCHMARK(from_string_double);
+
+static void from_string_string(benchmark::State& state) {
+    run_from_string<std::string>(state, "some string value");
+}
+BENCHMARK(from_string_string);
+
+static void from_string_istream(benchmark::State& state) {
+    run_from_string<point>(state, "12 34");
+}
+BENCHMARK(from_string_istream);
+
+static void to_string_int(benchmark::State& state) {
+    run_to_string(state, -123456);
+}
+BENCHMARK(to_string_int);
+
+static void to_string_double(benchmark::State& state) {
+    run_to_string(state, 3.14159265358979);
+}
+BENCHMARK(to_string_double);
+
+static void to_string_ostream(benchmark::State& state) {
+    run_to_string(state, point{12, 34});
+}
+BENCHMARK(to_string_ostream);
+
+/* Mostly plain arguments with some quoting, the shape of a typical job spec */
+static void command_line_split(benchmark::State& state) {
+    std::string line = "./program";
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        line += cpparg::util::join(
+            " --option", i, " /some/fairly/long/path/to/input/file", i, ".txt");
+        line += cpparg::util::join(" 'quoted value ", i, "'");
+    }
+
+    cpparg::command_line command_line;
+    for (auto _ : state) {
+        command_line.split(line);
+        benchmark::DoNotOptimize(command_line.argv());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(line.size()));
+}
+BENCHMARK(command_line_split)->Arg(10)->Arg(1000);
@@ -1,24 +1,51 @@
 #pragma once
 
 #include <algorithm>
+#include <any>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace cpparg {
 
 namespace util {
@@ -50,8 +77,157 @@ struct is_convertible_from_string<void> : std::false_type {};
 template<typename T>
 inline constexpr bool is_convertible_from_string_v = is_convertible_from_string<T>::value;
 
+template<typename T>
+inline constexpr bool is_char_v = std::is_same_v<T, char> || std::is_same_v<T, signed char> ||
+                                  std::is_same_v<T, unsigned char>;
+
+#if defined(__cpp_lib_to_chars)
+inline constexpr bool has_floating_from_chars = true;
+#else
+inline constexpr bool has_floating_from_chars = false;
+#endif
+
+/* Types handled by std::from_chars instead of std::istream */
+template<typename T>
+inline constexpr bool has_from_chars_v =
+    std::is_same_v<T, bool> || is_char_v<T> ||
+    (std::is_integral_v<T> && !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char16_t> &&
+     !std::is_same_v<T, char32_t>) ||
+    (std::is_floating_point_v<T> && has_floating_from_chars);
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/* Mimics std::istream: leading whitespace is skipped, trailing characters are rejected */
+template<typename T>
+inline bool from_chars(std::string_view s, T& result) {
+    const char* first = s.data();
+    const char* last = s.data() + s.size();
+    while (first != last && is_space(*first)) {
+        ++first;
+    }
+
+    if constexpr (is_char_v<T>) {
+        if (last - first != 1) {
+            return false;
+        }
+        result = static_cast<T>(*first);
+        return true;
+    } else if constexpr (std::is_same_v<T, bool>) {
+        unsigned value = 0;
+        if (!from_chars(std::string_view(first, last - first), value) || value > 1) {
+            return false;
+        }
+        result = value == 1;
+        return true;
+    } else {
+        /* std::from_chars does not accept explicit plus sign */
+        if (first != last && *first == '+') {
+            ++first;
+            if (first != last && *first == '-') {
+                return false;
+            }
+        }
+
+        auto [ptr, ec] = std::from_chars(first, last, result);
+        if constexpr (std::is_floating_point_v<T>) {
+            /* std::istream rejects "inf" and "nan", which std::from_chars accepts */
+            if (ec == std::errc{} && !std::isfinite(result)) {
+                return false;
+            }
+        }
+        return ec == std::errc{} && ptr == last;
+    }
+}
+
+/* std::streambuf reading directly from a string_view without copying it */
+class view_streambuf : public std::streambuf {
+public:
+    void reset(std::string_view view) {
+        char* begin = const_cast<char*>(view.data());
+        setg(begin, begin, begin + view.size());
+    }
+};
+
+struct input_stream {
+    view_streambuf buf;
+    std::istream stream{&buf};
+    bool in_use{false};
+};
+
+struct output_stream {
+    std::ostringstream stream;
+    bool in_use{false};
+};
+
+/* Marks a thread-local stream as busy, so nested conversions do not reuse it */
+template<typename Stream>
+class stream_lock {
+public:
+    stream_lock(Stream& stream)
+        : stream_(stream) {
+        stream_.in_use = true;
+    }
+
+    ~stream_lock() {
+        stream_.in_use = false;
+    }
+
+    stream_lock(const stream_lock&) = delete;
+    stream_lock& operator=(const stream_lock&) = delete;
+
+private:
+    Stream& stream_;
+};
+
+template<typename T>
+inline bool from_istream(input_stream& in, std::string_view s, T& result) {
+    stream_lock lock(in);
+    in.buf.reset(s);
+    in.stream.clear();
+    in.stream.flags(std::ios_base::skipws | std::ios_base::dec);
+    in.stream.width(0);
+    in.stream >> result;
+
+    return in.stream && in.stream.peek() == std::char_traits<char>::eof();
+}
+
+template<typename T>
+inline std::string to_ostream(output_stream& out, const T& t) {
+    stream_lock lock(out);
+    out.stream.clear();
+    /* the format a previous operator<< left behind is not this value's */
+    out.stream.flags(std::ios_base::skipws | std::ios_base::dec);
+    out.stream.precision(6);
+    out.stream.width(0);
+    out.stream.fill(' ');
+    out.stream.str("");
+    out.stream << t;
+    return out.stream.str();
+}
+
+/* Mimics std::ostream with default flags */
+template<typename T>
+inline std::string to_chars(T t) {
+    if constexpr (std::is_same_v<T, bool>) {
+        return t ? "1" : "0";
+    } else if constexpr (is_char_v<T>) {
+        return std::string(1, static_cast<char>(t));
+    } else {
+        char buf[64];
+        std::to_chars_result res;
+        if constexpr (std::is_floating_point_v<T>) {
+            res = std::to_chars(buf, buf + sizeof(buf), t, std::chars_format::general, 6);
+        } else {
+            res = std::to_chars(buf, buf + sizeof(buf), t);
+        }
+        return std::string(buf, res.ptr);
+    }
 }
 
+} // namespace detail
+
 class from_string_error : public std::runtime_error {
 public:
     from_string_error()
@@ -59,44 +235,57 @@ public:
     }
 };
 
+/* Non-throwing version of from_string; result is left unspecified on failure */
 template<typename T>
-inline T from_string(std::string_view s) {
+inline bool try_from_string(std::string_view s, T& result) {
     static_assert(detail::is_convertible_from_string_v<T>,
         "Cannot find std::istream& operator>>(std::istream&, T&)");
 
     if constexpr (std::is_same_v<std::string, T>) {
-        return str(s);
+        result.assign(s.begin(), s.end());
+        return true;
     } else if constexpr (std::is_same_v<std::string_view, T>) {
-        return s;
+        result = s;
+        return true;
+    } else if constexpr (detail::has_from_chars_v<T>) {
+        return detail::from_chars(s, result);
     } else {
-        static std::istringstream ss;
-        ss.clear();
-        ss.str(str(s));
-        T result;
-        ss >> result;
-
-        if (!ss) {
-            throw from_string_error{};
-        }
+        thread_local detail::input_stream in;
 
-        if (ss.peek() != std::char_traits<char>::eof()) {
-            throw from_string_error{};
+        if (in.in_use) {
+            detail::input_stream nested;
+            return detail::from_istream(nested, s, result);
         }
+        return detail::from_istream(in, s, result);
+    }
+}
 
-        return result;
+template<typename T>
+inline T from_string(std::string_view s) {
+    T result;
+    if (!try_from_string(s, result)) {
+        throw from_string_error{};
     }
+    return result;
 }
 
 template<typename T>
 inline std::string to_string(T&& t) {
-    if constexpr (std::is_same_v<std::string, std::decay_t<T>>) {
+    using value_t = std::decay_t<T>;
+    if constexpr (std::is_same_v<std::string, value_t>) {
         return t;
+    } else if constexpr (std::is_convertible_v<const value_t&, std::string_view>) {
+        return str(t);
+    } else if constexpr (detail::has_from_chars_v<value_t>) {
+        return detail::to_chars(t);
     } else {
-        static std::ostringstream os;
-        os.clear();
-        os.str("");
-        os << t;
-        return os.str();
+        thread_local detail::output_stream out;
+
+        if (out.in_use) {
+            detail::output_stream nested;
+            return detail::to_ostream(nested, t);
+        }
+        return detail::to_ostream(out, t);
     }
 }
 
@@ -161,863 +350,4670 @@ public:
     }
 };
 
-namespace detail {
+enum class parse_errc {
+    ok,
+    unknown_option,
+    argument_required,
+    invalid_argument,
+    not_repeatable,
+    required_missing,
+    too_many_free_arguments,
+    command_required,
+    unknown_command,
+    handler_error,
+    response_file_error,
+    ambiguous_option,
+};
 
-static constexpr std::string_view OFFSET = "  ";
-static constexpr size_t TAB_WIDTH = 4;
+class processor;
+
+namespace detail {
 
 template<typename Child>
-class parser_base {
+class parser_base;
+
+class mapped_file;
+
+template<typename Value>
+class long_name_table;
+
+struct token_walker;
+
+template<typename T, typename Alloc>
+bool convert_list(
+    std::string_view list,
+    char delimiter,
+    std::vector<T, Alloc>& dest,
+    size_t threads);
+
+} // namespace detail
+
+/*
+ * Outcome of parser_base::try_parse.
+ * The human-readable message is built only by message(); it refers to the parsed argv,
+ * so argv should outlive the result.
+ */
+class parse_result {
 public:
-    std::string help_message(std::string_view error_message = "") const {
-        std::string help = static_cast<const Child*>(this)->help_message_impl();
-        if (error_message.empty()) {
-            error_message = title_;
-        }
+    static constexpr size_t NO_TOKEN = std::numeric_limits<size_t>::max();
 
-        return util::join(error_message, '\n', help);
-    }
+    parse_result() = default;
 
-	[[noreturn]] void exit_with_help(std::string_view error_message = "", int errc = 1) const {
-        print_help(error_message);
-        exit(errc);
+    explicit operator bool() const {
+        return error_ == parse_errc::ok;
     }
 
-    void print_help(std::string_view error_message = "") const {
-        std::cerr << help_message(error_message) << std::endl;
+    parse_errc error() const {
+        return error_;
     }
 
-    Child& title(std::string_view v) {
-        title_ = util::str(v);
-        return static_cast<Child&>(*this);
+    /* index of the offending token in argv or NO_TOKEN */
+    size_t token_index() const {
+        return token_index_;
     }
 
-    int parse(int argc, const char* argv[], parsing_error_policy err = parsing_error_policy::exit)
-        const {
-        try {
-            return static_cast<const Child*>(this)->parse_impl(argc, argv);
-        } catch (const parser_error& error) {
-            switch (err) {
-            case parsing_error_policy::exit:
-                exit_with_help(error.what());
-            case parsing_error_policy::rethrow:
-                throw;
-            }
-        }
-
-        /* suppress warnings */
-        return 0;
+    std::string_view token() const {
+        return token_;
     }
 
-private:
-    std::string title_;
-};
-
-} // namespace detail
-
-class processor {
-public:
-    processor(size_t position, std::string_view name)
-        : lname_(util::str(name))
-        , position_(position) {
-        if (util::starts_with(name, "-")) {
-            throw std::logic_error("Option name cannot start with '-'");
-        }
+    /* processor that rejected the input, if any */
+    const processor* source() const {
+        return source_;
     }
 
-    processor(std::string_view lname)
-        : processor(NON_POSITIONAL, lname) {
+    /* value returned by the parser, i.e. by the selected command */
+    int value() const {
+        return value_;
     }
 
-    processor(char sname, std::string_view lname)
-        : processor(lname) {
-        sname_ = sname;
-        if (sname == '-') {
-            throw std::logic_error("Option name cannot start with '-'");
-        }
+    /* struct_parser::try_parse stopped at the help option; the caller decides what to do */
+    bool help_requested() const {
+        return help_requested_;
     }
 
-    processor(processor&& other) = default;
-    processor& operator=(processor&& other) = default;
+    /* Builds the message, looking for typo suggestions if needed; the parser should be alive */
+    std::string message() const;
 
-    processor(const processor& other) = delete;
-    processor& operator=(const processor& other) = delete;
+    /* throws the exception parser_base::parse would have thrown */
+    [[noreturn]] void raise() const;
 
-    template<typename Val>
-    processor& store(Val& val) {
-        return store<Val, Val>(val);
+private:
+    std::string_view suggest() const {
+        if (!suggest_) {
+            return {};
+        }
+        return suggest_(names_source_, typo_.empty() ? token_ : typo_);
     }
 
-    template<typename Val, typename Dest>
-    processor& store(Dest& dest) {
-        static_assert(std::is_assignable_v<Dest&, Val>, "Invalid store() value type");
+private:
+    template<typename Child>
+    friend class detail::parser_base;
+    friend class parser;
+    friend class compiled_parser;
+    friend class command_parser;
+    template<typename... Ts>
+    friend class static_parser;
+    template<typename Struct>
+    friend class struct_parser;
+    template<typename Value>
+    friend class detail::long_name_table;
+    friend struct detail::token_walker;
+
+    parse_result& fail(
+        parse_errc error,
+        size_t token_index = NO_TOKEN,
+        std::string_view token = "",
+        const processor* source = nullptr) {
+        error_ = error;
+        return at(token_index, token, source);
+    }
 
-        handler_ = [this, &dest](std::string_view sv) {
-            try {
-                dest = util::from_string<Val>(sv);
-            } catch (std::ios_base::failure& fail) {
-                throw processor_error(name(), fail.what());
-            }
-        };
+    /* Remembers what is being parsed, so exceptions from user handlers can be attributed */
+    parse_result& at(size_t token_index, std::string_view token, const processor* source) {
+        token_index_ = token_index;
+        token_ = token;
+        source_ = source;
         return *this;
     }
 
-    template<typename Dest, typename Val>
-    processor& store_value(Dest& dest, Val&& val) {
-        static_assert(std::is_assignable_v<Dest&, Val>, "Invalid store_value() value type");
+private:
+    parse_errc error_{parse_errc::ok};
+    size_t token_index_{NO_TOKEN};
+    std::string_view token_;
+    const processor* source_{nullptr};
+    /* option name for errors without a processor */
+    std::string_view option_name_;
+    /* command_required and unknown_command: the deepest command that matched */
+    std::string_view command_path_;
+
+    /* unknown_option and unknown_command: finds a known name close to the token */
+    std::string_view (*suggest_)(const void* source, std::string_view token){nullptr};
+    /* what suggest_ looks at instead of the token: the whole cluster for -verbsoe */
+    std::string_view typo_;
+    /* ambiguous_option: lists the options the token abbreviates */
+    std::string (*candidates_)(const void* source, std::string_view token){nullptr};
+    /* the parser or command the two above look into */
+    const void* names_source_{nullptr};
+    int value_{0};
+    bool help_requested_{false};
+
+    /* too_many_free_arguments */
+    size_t count_{0};
+    size_t max_count_{0};
 
-        no_argument();
+    /* handler_error */
+    std::string handler_message_;
 
-        handler_ = [&dest, val{std::forward<Val>(val)}](auto) {
-            dest = val;
-        };
+    /* response files the token views may point into */
+    std::vector<std::shared_ptr<const detail::mapped_file>> files_;
+};
 
-        return *this;
-    }
+namespace detail {
 
-    processor& flag(bool& flag) {
-        no_argument().optional().default_value("disable");
+static constexpr std::string_view OFFSET = "  ";
+static constexpr size_t TAB_WIDTH = 4;
 
-        handler_ = [&flag](std::string_view sv) {
-            flag = sv.empty();
-        };
+/* FNV-1a */
+constexpr uint64_t hash_name(std::string_view name, uint64_t seed = 0) {
+    uint64_t hash = 14695981039346656037ull ^ (seed * 0x9e3779b97f4a7c15ull);
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
 
-        return *this;
+/*
+ * Flat open-addressing hash table keyed by string_view.
+ * Keys are not copied, so they must outlive the table.
+ * Lookups never allocate.
+ */
+template<typename Value>
+class name_table {
+public:
+    bool insert(std::string_view key, Value value) {
+        if (find(key)) {
+            return false;
+        }
+        if ((size_ + 1) * 2 > slots_.size()) {
+            rehash(std::max<size_t>(MIN_CAPACITY, slots_.size() * 2));
+        }
+        place(slot{key, hash_name(key), std::move(value), true});
+        ++size_;
+        return true;
     }
 
-    template<typename Handler>
-    processor& handle(Handler&& handler) {
-        static constexpr bool takes_string_view = std::is_invocable_v<Handler, std::string_view>;
-        static constexpr bool takes_string = std::is_invocable_v<Handler, std::string>;
-        static constexpr bool takes_void = std::is_invocable_v<Handler>;
-        static_assert(
-            takes_string_view || takes_string || takes_void,
-            "Handler should take std::string_view, std::string or void as the first argument");
-        if constexpr (takes_string_view) {
-            handler_ = std::forward<Handler>(handler);
-        } else if constexpr (takes_string) {
-            handler_ = [handler{std::forward<Handler>(handler)}](std::string_view arg) mutable {
-                handler(util::str(arg));
-            };
-        } else {
-            handler_ = [handler{std::forward<Handler>(handler)}](std::string_view) mutable {
-                handler();
-            };
+    const Value* find(std::string_view key) const {
+        if (slots_.empty()) {
+            return nullptr;
         }
 
-        return *this;
+        const uint64_t hash = hash_name(key);
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const slot& s = slots_[i];
+            if (!s.used) {
+                return nullptr;
+            }
+            if (s.hash == hash && s.key == key) {
+                return &s.value;
+            }
+        }
     }
 
-    template<typename Arg, typename Handler>
-    processor& handle(Handler&& handler) {
-        return handle([handler{std::forward<Handler>(handler)}](std::string_view arg) mutable {
-            handler(util::from_string<Arg>(arg));
-        });
+    size_t size() const {
+        return size_;
     }
 
-    template<
-        typename output_it,
-        std::enable_if_t<std::is_convertible_v<
-            std::output_iterator_tag,
-            typename std::iterator_traits<output_it>::iterator_category>>* = nullptr>
-    processor& append(output_it it) {
-        return append_impl<typename std::iterator_traits<output_it>::value_type>(it);
+private:
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    struct slot {
+        std::string_view key;
+        uint64_t hash{0};
+        Value value{};
+        bool used{false};
+    };
+
+    void rehash(size_t capacity) {
+        std::vector<slot> old(capacity);
+        old.swap(slots_);
+        for (slot& s : old) {
+            if (s.used) {
+                place(std::move(s));
+            }
+        }
     }
 
-    template<typename Container>
-    processor& append(Container& cont) {
-        return append_impl<std::decay_t<decltype(*cont.begin())>>(std::back_inserter(cont));
+    void place(slot&& s) {
+        const size_t mask = slots_.size() - 1;
+        size_t i = s.hash & mask;
+        while (slots_[i].used) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = std::move(s);
     }
 
-    processor& required() {
-        required_ = true;
-        return *this;
+private:
+    std::vector<slot> slots_;
+    size_t size_{0};
+};
+
+/*
+ * Move-only std::function replacement.
+ * Callables up to Capacity bytes are stored inline, larger ones are moved to the heap.
+ */
+template<typename Signature, size_t Capacity = 4 * sizeof(void*)>
+class inline_function;
+
+template<typename R, typename... Args, size_t Capacity>
+class inline_function<R(Args...), Capacity> {
+public:
+    inline_function() = default;
+
+    template<
+        typename F,
+        std::enable_if_t<!std::is_same_v<std::decay_t<F>, inline_function>>* = nullptr>
+    inline_function(F&& f) {
+        emplace(std::forward<F>(f));
     }
 
-    processor& optional() {
-        required_ = false;
-        return *this;
+    inline_function(inline_function&& other) noexcept {
+        move_from(other);
     }
 
-    processor& repeatable() {
-        repeatable_ = true;
+    inline_function& operator=(inline_function&& other) noexcept {
+        if (this != &other) {
+            reset();
+            move_from(other);
+        }
         return *this;
     }
-    
-    processor& no_argument() {
-        has_argument_ = false;
+
+    template<
+        typename F,
+        std::enable_if_t<!std::is_same_v<std::decay_t<F>, inline_function>>* = nullptr>
+    inline_function& operator=(F&& f) {
+        reset();
+        emplace(std::forward<F>(f));
         return *this;
     }
 
-    processor& value_type(std::string_view type) {
-        arg_type_ = util::str(type);
-        return *this;
+    inline_function(const inline_function&) = delete;
+    inline_function& operator=(const inline_function&) = delete;
+
+    ~inline_function() {
+        reset();
     }
 
-    template<typename T>
-    processor& default_value(T val) {
-        has_default_value_ = true;
-        default_value_ = util::to_string(val);
-        if (default_value_.empty()) {
-            throw std::logic_error("Empty default value");
-        }
-        return *this;
+    explicit operator bool() const {
+        return invoke_ != nullptr;
     }
 
-    processor& description(std::string_view descr) {
-        description_ = util::str(descr);
-        return *this;
+    R operator()(Args... args) const {
+        return invoke_(storage_, std::forward<Args>(args)...);
     }
 
 private:
-    friend class parser;
+    using invoke_func = R (*)(void*, Args...);
+    /* moves the callable from src to dst, or destroys src if dst is null */
+    using manage_func = void (*)(void* src, void* dst);
 
-    void parse(std::string_view arg = "") const {
-        if (!handler_) {
-            throw std::logic_error(
-                "Cannot parse option " + name() +
-                ": the handler was not set. Use either store() or handle().");
+    template<typename F>
+    static constexpr bool fits_inline = sizeof(F) <= Capacity &&
+                                        alignof(F) <= alignof(std::max_align_t) &&
+                                        std::is_nothrow_move_constructible_v<F>;
+
+    template<typename F>
+    void emplace(F&& f) {
+        using func_t = std::decay_t<F>;
+
+        if constexpr (fits_inline<func_t>) {
+            new (storage_) func_t(std::forward<F>(f));
+            invoke_ = [](void* storage, Args... args) -> R {
+                return (*static_cast<func_t*>(storage))(std::forward<Args>(args)...);
+            };
+            manage_ = [](void* src, void* dst) {
+                func_t* func = static_cast<func_t*>(src);
+                if (dst) {
+                    new (dst) func_t(std::move(*func));
+                }
+                func->~func_t();
+            };
+        } else {
+            new (storage_) func_t*(new func_t(std::forward<F>(f)));
+            invoke_ = [](void* storage, Args... args) -> R {
+                return (**static_cast<func_t**>(storage))(std::forward<Args>(args)...);
+            };
+            manage_ = [](void* src, void* dst) {
+                func_t** func = static_cast<func_t**>(src);
+                if (dst) {
+                    new (dst) func_t*(*func);
+                } else {
+                    delete *func;
+                }
+            };
         }
-        if (arg.empty() && has_argument_) {
-            throw processor_error(name(), "argument required.");
+    }
+
+    void move_from(inline_function& other) {
+        if (other.invoke_) {
+            other.manage_(other.storage_, storage_);
+            invoke_ = std::exchange(other.invoke_, nullptr);
+            manage_ = std::exchange(other.manage_, nullptr);
         }
-        handler_(arg);
     }
 
-    void default_handler() const {
-        if (required_) {
-            throw processor_error("Option " + name() + " is required.");
-        } else if (has_default_value_) {
-            parse(default_value_);
+    void reset() {
+        if (invoke_) {
+            manage_(storage_, nullptr);
+            invoke_ = nullptr;
+            manage_ = nullptr;
         }
     }
 
-    template<
-        typename arg_t,
-        typename output_it,
-        std::enable_if_t<std::is_convertible_v<
-            std::output_iterator_tag,
-            typename std::iterator_traits<output_it>::iterator_category>>* = nullptr>
-    processor& append_impl(output_it it) {
-        if (!is_repeatable()) {
-            throw std::logic_error(
-                "Cannot use append with non-repeatable processor; call repeatable() before "
-                "append()");
+private:
+    alignas(std::max_align_t) mutable unsigned char storage_[Capacity];
+    invoke_func invoke_{nullptr};
+    manage_func manage_{nullptr};
+};
+
+/* Append-only storage for strings; interned views stay valid while the arena lives */
+class string_arena {
+public:
+    string_arena() = default;
+
+    string_arena(string_arena&&) = default;
+    string_arena& operator=(string_arena&&) = default;
+
+    string_arena(const string_arena&) = delete;
+    string_arena& operator=(const string_arena&) = delete;
+
+    std::string_view intern(std::string_view s) {
+        if (s.empty()) {
+            return {};
         }
 
-        return handle<arg_t>([it](arg_t arg) mutable { *(it++) = std::move(arg); });
+        char* dst = nullptr;
+        if (s.size() > CHUNK_SIZE / 4) {
+            /* large strings get their own chunk, so the current one is not wasted */
+            chunks_.push_back(std::make_unique<char[]>(s.size()));
+            dst = chunks_.back().get();
+        } else {
+            if (s.size() > left_) {
+                chunks_.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+                pos_ = chunks_.back().get();
+                left_ = CHUNK_SIZE;
+            }
+            dst = pos_;
+            pos_ += s.size();
+            left_ -= s.size();
+        }
+
+        std::copy(s.begin(), s.end(), dst);
+        return std::string_view(dst, s.size());
     }
 
-    char short_name() const {
-        return sname_;
+private:
+    static constexpr size_t CHUNK_SIZE = 4096;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* pos_{nullptr};
+    size_t left_{0};
+};
+
+/* Chunked vector whose elements never move once constructed */
+template<typename T, size_t ChunkSize = 64>
+class stable_storage {
+public:
+    stable_storage() = default;
+
+    stable_storage(stable_storage&& other) noexcept
+        : chunks_(std::move(other.chunks_))
+        , size_(std::exchange(other.size_, 0)) {
     }
 
-    std::string_view long_name() const {
-        return lname_;
+    stable_storage& operator=(stable_storage&& other) noexcept {
+        if (this != &other) {
+            clear();
+            chunks_ = std::move(other.chunks_);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
     }
 
-    std::string_view type() const {
-        return arg_type_;
+    stable_storage(const stable_storage&) = delete;
+    stable_storage& operator=(const stable_storage&) = delete;
+
+    ~stable_storage() {
+        clear();
     }
 
-    bool is_required() const {
-        return required_;
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ == chunks_.size() * ChunkSize) {
+            chunks_.push_back(std::make_unique<chunk>());
+        }
+        T* result = new (slot(size_)) T(std::forward<Args>(args)...);
+        ++size_;
+        return *result;
     }
 
-    bool is_optional() const {
-        return !required_;
+    T& operator[](size_t i) {
+        return *std::launder(reinterpret_cast<T*>(slot(i)));
     }
 
-    bool is_positional() const {
-        return position_ != NON_POSITIONAL;
+    const T& operator[](size_t i) const {
+        return *std::launder(reinterpret_cast<const T*>(slot(i)));
     }
 
-    bool is_repeatable() const {
-        return repeatable_;
+    T& back() {
+        return (*this)[size_ - 1];
     }
 
-    bool has_argument() const {
-        return has_argument_;
+    size_t size() const {
+        return size_;
     }
 
-    std::string name() const {
-        if (lname_.empty()) {
-            /* option has only short name */
-            return std::string(1, sname_);
-        } else {
-            return lname_;
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    void clear() {
+        while (size_ > 0) {
+            back().~T();
+            --size_;
         }
+        chunks_.clear();
     }
 
-    std::string help() const {
-        std::stringstream result;
+private:
+    struct chunk {
+        alignas(T) unsigned char data[sizeof(T) * ChunkSize];
+    };
 
-        result << detail::OFFSET;
+    unsigned char* slot(size_t i) const {
+        return chunks_[i / ChunkSize]->data + (i % ChunkSize) * sizeof(T);
+    }
 
-        const bool has_two_names = !lname_.empty() && sname_ != EMPTY_SHORT_NAME;
+private:
+    std::vector<std::unique_ptr<chunk>> chunks_;
+    size_t size_{0};
+};
 
-        if (is_positional()) {
-            result << lname_;
-        } else {
-            if (sname_ != EMPTY_SHORT_NAME) {
-                result << "-" << sname_;
-            }
-            if (has_two_names) {
-                result << ", ";
-            }
-            if (!lname_.empty()) {
-                result << "--" << lname_;
-            }
-        }
-        if (!type().empty()) {
-            result << " <" << type() << ">";
-        }
-        result << '\t';
-        result << description_;
-        if (has_default_value_) {
-            result << " [default = " << default_value_ << "]";
-        }
-        if (is_repeatable()) {
-            result << " (repeatable)";
-        }
+inline size_t count_trailing_zeros(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(word));
+#else
+    size_t result = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        ++result;
+    }
+    return result;
+#endif
+}
 
-        return result.str();
+/* Dynamic bitset, small sets are stored inline */
+class bitset {
+public:
+    static constexpr size_t WORD_BITS = 64;
+
+    bitset(size_t size = 0) {
+        resize(size);
     }
 
-    std::string usage() const {
-        std::stringstream result;
+    bitset(const bitset& other) {
+        *this = other;
+    }
 
-        if (is_optional()) {
-            result << '[';
-        }
-        if (is_positional()) {
-            result << lname_;
-        } else {
-            if (lname_.empty()) {
-                result << "-" << std::string(1, sname_);
-            } else {
-                result << "--" << lname_;
-            }
+    bitset& operator=(const bitset& other) {
+        if (this != &other) {
+            size_ = other.size_;
+            heap_ = other.heap_;
+            std::copy(std::begin(other.inline_), std::end(other.inline_), std::begin(inline_));
         }
-        if (has_argument_ && !arg_type_.empty()) {
-            result << " <" << arg_type_ << ">";
+        return *this;
+    }
+
+    /* Keeps existing bits, new bits are cleared */
+    void resize(size_t size) {
+        const size_t old_words = word_count();
+        const size_t new_words = (size + WORD_BITS - 1) / WORD_BITS;
+        if (new_words > INLINE_WORDS && heap_.empty()) {
+            heap_.assign(inline_, inline_ + old_words);
         }
-        if (is_optional()) {
-            result << ']';
+        if (new_words > INLINE_WORDS) {
+            heap_.resize(new_words, 0);
         }
-
-        return result.str();
+        size_ = size;
     }
 
-private:
-    static constexpr char EMPTY_SHORT_NAME = '\0';
-    static constexpr size_t NON_POSITIONAL = std::numeric_limits<size_t>::max();
+    /* Clears all bits, keeps the allocated storage */
+    void assign(size_t size) {
+        resize(size);
+        std::fill(data(), data() + word_count(), 0);
+    }
 
-    bool required_{false};
-    bool repeatable_{false};
-    bool has_default_value_{false};
-    bool has_argument_{true};
+    size_t size() const {
+        return size_;
+    }
 
-    char sname_{EMPTY_SHORT_NAME};
-    std::string lname_;
+    size_t word_count() const {
+        return (size_ + WORD_BITS - 1) / WORD_BITS;
+    }
 
-    size_t position_{NON_POSITIONAL};
+    uint64_t word(size_t i) const {
+        return data()[i];
+    }
 
-    std::string arg_type_;
-    std::string description_;
-    std::string default_value_;
+    bool test(size_t i) const {
+        return (data()[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+    }
 
-    std::function<void(std::string_view)> handler_;
-};
+    void set(size_t i, bool value = true) {
+        uint64_t& w = data()[i / WORD_BITS];
+        const uint64_t bit = uint64_t{1} << (i % WORD_BITS);
+        w = value ? (w | bit) : (w & ~bit);
+    }
 
-class invalid_free_arguments_count : public processor_error {
-public:
-    invalid_free_arguments_count(size_t count, size_t maximum)
-        : processor_error(util::join(
-              "Invalid free arguments count, got ",
-              count,
-              " while maximum is ",
-              maximum)) {
+    void reset(size_t i) {
+        set(i, false);
     }
-};
 
-class free_args_processor {
-public:
-    free_args_processor() = default;
+private:
+    static constexpr size_t INLINE_WORDS = 4;
 
-    free_args_processor& max(size_t count) {
-        max_count_ = count;
-        return *this;
+    uint64_t* data() {
+        return heap_.empty() ? inline_ : heap_.data();
     }
 
-    free_args_processor& unlimited() {
-        return max(UNLIMITED);
+    const uint64_t* data() const {
+        return heap_.empty() ? inline_ : heap_.data();
     }
 
-    template<typename Handler>
-    free_args_processor& handle(Handler&& handler) {
-        static_assert(
-            std::is_invocable_v<Handler, const std::vector<std::string_view>&>,
-            "Handler should take std::vector<std::string_view> as the first argument");
-        handler_ = std::forward<Handler>(handler);
-        return *this;
+private:
+    size_t size_{0};
+    uint64_t inline_[INLINE_WORDS]{};
+    std::vector<uint64_t> heap_;
+};
+
+/*
+ * Sorted names for shell completion and abbreviated options. Names are either filled
+ * on the first query, and refilled only when the number of sources changes, or added
+ * one by one; either way they are sorted lazily, so registering options costs nothing.
+ * Names must outlive the index.
+ */
+class prefix_index {
+public:
+    /* fill(std::vector<std::string_view>&) adds the names */
+    template<typename Fill>
+    const prefix_index& update(size_t sources, Fill&& fill) {
+        if (!built_ || sources != sources_) {
+            names_.clear();
+            fill(names_);
+            sources_ = sources;
+            built_ = true;
+            sorted_ = false;
+        }
+        return sort();
     }
 
-    template<typename T>
-    free_args_processor& store(std::vector<T>& free_args) {
-        handler_ = [&free_args](const std::vector<std::string_view>& args) {
-            for (auto sw : args) {
-                free_args.push_back(util::from_string<T>(sw));
-            }
-        };
-        return *this;
+    void add(std::string_view name) {
+        names_.push_back(name);
+        sorted_ = false;
     }
 
-    free_args_processor& name(std::string_view name) {
-        name_ = util::str(name);
+    /* sorts in place, so queries after add() do not allocate */
+    const prefix_index& sort() {
+        if (!sorted_) {
+            std::sort(names_.begin(), names_.end());
+            sorted_ = true;
+        }
         return *this;
     }
 
-    void parse(const std::vector<std::string_view>& args) const {
-        if (args.size() > max_count_) {
-            throw invalid_free_arguments_count(args.size(), max_count_);
+    /* The only name starting with prefix; empty if there is none or there are several */
+    std::string_view unique(std::string_view prefix, bool& ambiguous) const {
+        auto it = std::lower_bound(names_.begin(), names_.end(), prefix);
+        ambiguous = false;
+        if (it == names_.end() || !util::starts_with(*it, prefix)) {
+            return {};
         }
-        if (handler_) {
-            handler_(args);
+        /* sorted, so a second match can only be the next name */
+        if (it + 1 != names_.end() && util::starts_with(it[1], prefix)) {
+            ambiguous = true;
+            return {};
         }
+        return *it;
     }
 
-    size_t max_count() const {
-        return max_count_;
-    }
-
-    std::string usage() const {
-        if (max_count() > 0) {
-            return util::join(name_, "...");
-        } else {
-            return "";
+    template<typename Callback>
+    void for_each(std::string_view prefix, Callback&& callback) const {
+        auto it = std::lower_bound(names_.begin(), names_.end(), prefix);
+        for (; it != names_.end() && util::starts_with(*it, prefix); ++it) {
+            callback(*it);
         }
     }
 
-    std::string help() const {
-        if (max_count() > 0) {
-            return util::join(name_, "...");
-        } else {
-            return "";
-        }
+    const std::vector<std::string_view>& names() const {
+        return names_;
     }
 
 private:
-    static constexpr size_t UNLIMITED = std::numeric_limits<size_t>::max();
-
-    size_t max_count_{0};
-    std::string name_;
-    std::function<void(const std::vector<std::string_view>&)> handler_;
+    std::vector<std::string_view> names_;
+    size_t sources_{0};
+    bool built_{false};
+    bool sorted_{true};
 };
 
-namespace detail {
 
-class argument_parser {
+/*
+ * Damerau distance (optimal string alignment) to a fixed pattern of at most 64 characters:
+ * insertions, deletions, substitutions and swaps of adjacent characters cost one edit each.
+ * Bit-parallel (Myers, Hyyro): a whole column of the distance matrix is one word,
+ * so a text costs a few word operations per character. Used to suggest names for typos.
+ */
+class edit_distance {
 public:
-    enum class arg_type { positional, short_name, long_name, free_arg, free_arg_delimiter };
+    static constexpr size_t MAX_PATTERN_SIZE = 64;
 
-    argument_parser(std::string_view arg, size_t position, size_t positional_count)
-        : arg_(arg)
-        , can_be_positilnal_(position < positional_count) {
+    explicit edit_distance(std::string_view pattern)
+        : size_(pattern.size()) {
+        for (size_t i = 0; i < std::min(size_, MAX_PATTERN_SIZE); ++i) {
+            peq_[static_cast<unsigned char>(pattern[i])] |= uint64_t{1} << i;
+        }
     }
 
-    arg_type type() const {
-        if (util::starts_with(arg_, "--")) {
-            /* ./command ... -- free args */
-            if (arg_.size() == 2) {
-                return arg_type::free_arg_delimiter;
-            } else {
-                return arg_type::long_name;
+    /* the distance, or limit + 1 as soon as it is known to exceed limit */
+    size_t operator()(std::string_view text, size_t limit) const {
+        const size_t difference = text.size() > size_ ? text.size() - size_ : size_ - text.size();
+        if (size_ > MAX_PATTERN_SIZE || difference > limit) {
+            return limit + 1;
+        }
+        if (size_ == 0) {
+            return text.size();
+        }
+
+        const uint64_t last = uint64_t{1} << (size_ - 1);
+        uint64_t pv = ~uint64_t{0};
+        uint64_t mv = 0;
+        /* diagonal zero deltas and matches of the previous text character, for swaps */
+        uint64_t d0 = 0;
+        uint64_t previous_eq = 0;
+        size_t score = size_;
+
+        for (size_t j = 0; j < text.size(); ++j) {
+            const uint64_t eq = peq_[static_cast<unsigned char>(text[j])];
+            const uint64_t swapped = ((~d0 & eq) << 1) & previous_eq;
+            d0 = (((eq & pv) + pv) ^ pv) | eq | mv | swapped;
+            uint64_t ph = mv | ~(d0 | pv);
+            uint64_t mh = pv & d0;
+            if (ph & last) {
+                ++score;
+            } else if (mh & last) {
+                --score;
+            }
+            /* the first row of the matrix grows by one per text character */
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(d0 | ph);
+            mv = ph & d0;
+            previous_eq = eq;
+
+            /* every remaining character lowers the distance by one at most */
+            const size_t remaining = text.size() - j - 1;
+            if (score > limit + remaining) {
+                return limit + 1;
             }
-        } else if (util::starts_with(arg_, "-")) {
-            return arg_type::short_name;
-        } else if (can_be_positilnal_) {
-            return arg_type::positional;
-        } else {
-            return arg_type::free_arg;
         }
+        return score;
     }
 
-    std::string_view name() const {
-        switch (type()) {
-        case arg_type::short_name:
-            return arg_.substr(1);
-        case arg_type::long_name:
-            return arg_.substr(2);
-        default:
-            return arg_;
+    /* the closest name within the typo limit for the pattern, or an empty view */
+    template<typename Names>
+    std::string_view closest(const Names& names) const {
+        size_t limit = std::max<size_t>(1, size_ / 3);
+        std::string_view result;
+        for (std::string_view name : names) {
+            const size_t distance = (*this)(name, limit);
+            if (distance <= limit) {
+                result = name;
+                if (distance == 0) {
+                    break;
+                }
+                /* only strictly closer names are interesting from now on */
+                limit = distance - 1;
+            }
         }
+        return result;
     }
 
 private:
-    std::string_view arg_;
-    bool can_be_positilnal_;
+    std::array<uint64_t, 256> peq_{};
+    size_t size_;
 };
 
-} // namespace detail
-
-class parser : public detail::parser_base<parser> {
+/*
+ * Long option names of a parser: exact lookups, abbreviations, typo suggestions and
+ * the names an ambiguous abbreviation matches. The sorted names are built by the first
+ * query that needs them; call sort() once all names are inserted to share the table
+ * between threads. Names must outlive the table.
+ */
+template<typename Value>
+class long_name_table {
 public:
-    parser(std::string_view program)
-        : program_(util::str(program)) {
+    /* false if the name is already used */
+    bool insert(std::string_view name, Value value) {
+        if (!table_.insert(name, std::move(value))) {
+            return false;
+        }
+        sorted_.add(name);
+        return true;
     }
 
-    processor& add(std::string_view lname) {
-        return create_processor(lname);
+    void sort() {
+        sorted_.sort();
     }
 
-    processor& add(char sname, std::string_view lname = "") {
-        return create_processor(sname, lname);
+    const Value* find(std::string_view name) const {
+        return table_.find(name);
     }
 
-    processor& positional(std::string_view name) {
-        processors_.emplace_back(std::make_unique<processor>(positional_.size(), name));
-        processor& result = *processors_.back();
-        positional_.push_back(&result);
-        return result;
+    /* The value of the name, or with abbreviations of the only name it abbreviates: --verb */
+    const Value* find(std::string_view name, bool abbreviations, bool& ambiguous) const {
+        ambiguous = false;
+        if (const Value* found = table_.find(name)) {
+            return found;
+        }
+        if (!abbreviations || name.empty()) {
+            return nullptr;
+        }
+        if (std::string_view full = sorted_.sort().unique(name, ambiguous); !full.empty()) {
+            return table_.find(full);
+        }
+        return nullptr;
     }
 
-    free_args_processor& free_arguments(std::string_view name) {
-        return free_args_processor_.name(name);
+    /* names starting with prefix, in order */
+    template<typename Callback>
+    void for_each(std::string_view prefix, Callback&& callback) const {
+        sorted_.sort().for_each(prefix, std::forward<Callback>(callback));
     }
 
-    parser& add_help(char sname, std::string_view lname = "") {
-        if (help_) {
-            throw std::logic_error("Cannot add two help options");
-        }
-
-        processor& result = create_processor(sname, lname);
-        result.no_argument().description("Print this help and exit").handle([this](std::string_view) {
-            exit_with_help("", 0);
-        });
-
-        help_ = &result;
+    /* Lets result suggest a name for an unknown option and list the ones of an ambiguous one */
+    void describe(parse_result& result) const {
+        result.suggest_ = &long_name_table::suggest;
+        result.candidates_ = &long_name_table::candidates;
+        result.names_source_ = this;
+    }
 
-        return *this;
+private:
+    static std::string_view suggest(const void* self, std::string_view token) {
+        const long_name_table& source = *static_cast<const long_name_table*>(self);
+        return edit_distance(token).closest(source.sorted_.sort().names());
     }
 
-    int parse_impl(int, const char* argv[]) const {
-        size_t next_positional = 0;
-        std::vector<std::string_view> free_args;
+    static std::string candidates(const void* self, std::string_view prefix) {
+        std::string result;
+        static_cast<const long_name_table*>(self)->for_each(prefix, [&result](auto name) {
+            result += util::join(result.empty() ? "--" : ", --", name);
+        });
+        return result;
+    }
 
-        std::unordered_set<const processor*> unused;
-        for (const auto& p : processors_) {
-            unused.insert(p.get());
-        }
+private:
+    name_table<Value> table_;
+    mutable prefix_index sorted_;
+};
 
-        bool was_free_arg_delimiter = false;
+/* Hidden option that turns parse() into a completion query, see completion_script() */
+static constexpr std::string_view COMPLETE_OPTION = "--__complete";
 
-        while (*++argv) {
-            detail::argument_parser arg_parser(*argv, next_positional, positional_.size());
-            if (arg_parser.type() == detail::argument_parser::arg_type::free_arg ||
-                was_free_arg_delimiter) {
-                free_args.push_back(arg_parser.name());
-                continue;
-            }
+template<typename Child>
+class parser_base {
+public:
+    std::string help_message(std::string_view error_message = "") const {
+        std::string help = static_cast<const Child*>(this)->help_message_impl();
+        if (error_message.empty()) {
+            error_message = title_;
+        }
+
+        return util::join(error_message, '\n', help);
+    }
+
+	[[noreturn]] void exit_with_help(std::string_view error_message = "", int errc = 1) const {
+        print_help(error_message);
+        exit(errc);
+    }
+
+    void print_help(std::string_view error_message = "") const {
+        std::cerr << help_message(error_message) << std::endl;
+    }
+
+    /* Help printed by parse() when argv is rejected; command_parser overrides it */
+    std::string error_help_message(int, const char*[], std::string_view error_message) const {
+        return help_message(error_message);
+    }
+
+    Child& title(std::string_view v) {
+        title_ = util::str(v);
+        return static_cast<Child&>(*this);
+    }
+
+    /*
+     * Lets parse() answer the completion queries of completion_script(): when the first
+     * argument is --__complete, it writes the completions to stdout and exits.
+     * Disabled by default, so argv of untrusted origin cannot end the process.
+     */
+    Child& completion(bool enabled = true) {
+        completion_ = enabled;
+        return static_cast<Child&>(*this);
+    }
+
+    int parse(int argc, const char* argv[], parsing_error_policy err = parsing_error_policy::exit)
+        const {
+        if (completion_ && argc > 1 && argv[1] == COMPLETE_OPTION) {
+            /* words typed after the program name, the last one being completed */
+            std::vector<std::string_view> words(argv + 2, argv + argc);
+            static_cast<const Child*>(this)->complete(words, std::cout);
+            std::cout.flush();
+            exit(0);
+        }
+
+        try {
+            return static_cast<const Child*>(this)->parse_impl(argc, argv);
+        } catch (const parser_error& error) {
+            switch (err) {
+            case parsing_error_policy::exit:
+                std::cerr << static_cast<const Child*>(this)->error_help_message(
+                                 argc, argv, error.what())
+                          << std::endl;
+                exit(1);
+            case parsing_error_policy::rethrow:
+                throw;
+            }
+        }
+
+        /* suppress warnings */
+        return 0;
+    }
+
+    /*
+     * Never throws: invalid input is reported through the result, and so is any exception
+     * of a user handler or conversion, as handler_error (from_string_error as invalid_argument)
+     */
+    parse_result try_parse(int argc, const char* argv[]) const {
+        parse_result result;
+        /* the token and the processor were recorded before the handler was called */
+        try {
+            static_cast<const Child*>(this)->parse_core(argc, argv, result);
+        } catch (const util::from_string_error&) {
+            result.error_ = parse_errc::invalid_argument;
+        } catch (const std::exception& error) {
+            result.error_ = parse_errc::handler_error;
+            result.handler_message_ = error.what();
+        } catch (...) {
+            result.error_ = parse_errc::handler_error;
+            result.handler_message_ = "Handler threw an unknown exception.";
+        }
+        return result;
+    }
+
+private:
+    std::string title_;
+    bool completion_{false};
+};
+
+/* Stateless argument validator for places where the conversion target is not available */
+template<typename T>
+bool check_conversion(std::string_view sv) {
+    T value;
+    return util::try_from_string(sv, value);
+}
+
+template<typename Container, typename = void>
+struct has_reserve : std::false_type {};
+
+template<typename Container>
+struct has_reserve<Container, std::void_t<decltype(std::declval<Container&>().reserve(size_t{}))>>
+    : std::true_type {};
+
+/* Makes room for count more elements if the container can do that in advance */
+template<typename Container>
+void reserve_more(Container& cont, size_t count) {
+    if constexpr (has_reserve<Container>::value) {
+        cont.reserve(cont.size() + count);
+    }
+}
+
+} // namespace detail
+
+class processor {
+public:
+    /* A processor made outside of a parser keeps its strings in an arena of its own */
+    processor(size_t position, std::string_view name)
+        : processor(nullptr, position, name) {
+    }
+
+    processor(std::string_view lname)
+        : processor(nullptr, NON_POSITIONAL, lname) {
+    }
+
+    processor(char sname, std::string_view lname)
+        : processor(nullptr, sname, lname) {
+    }
+
+    processor(processor&& other) = default;
+    processor& operator=(processor&& other) = default;
+
+    processor(const processor& other) = delete;
+    processor& operator=(const processor& other) = delete;
+
+    template<typename Val>
+    processor& store(Val& val) {
+        return store<Val, Val>(val);
+    }
+
+    template<typename Val, typename Dest>
+    processor& store(Dest& dest) {
+        static_assert(std::is_assignable_v<Dest&, Val>, "Invalid store() value type");
+
+        handler_ = [&dest](std::string_view sv) {
+            Val value;
+            if (!util::try_from_string(sv, value)) {
+                return false;
+            }
+            dest = std::move(value);
+            return true;
+        };
+        check_ = &detail::check_conversion<Val>;
+        restore_on_reset(dest);
+        return *this;
+    }
+
+    /* Only validates the argument; for compiled parsers, which return values per call */
+    template<typename Val>
+    processor& check() {
+        handler_ = &detail::check_conversion<Val>;
+        check_ = &detail::check_conversion<Val>;
+        return *this;
+    }
+
+    template<typename Dest, typename Val>
+    processor& store_value(Dest& dest, Val&& val) {
+        static_assert(std::is_assignable_v<Dest&, Val>, "Invalid store_value() value type");
+
+        no_argument();
+
+        handler_ = [&dest, val{std::forward<Val>(val)}](auto) {
+            dest = val;
+            return true;
+        };
+        check_ = nullptr;
+        restore_on_reset(dest);
+
+        return *this;
+    }
+
+    processor& flag(bool& flag) {
+        no_argument().optional().default_value("disable");
+
+        handler_ = [&flag](std::string_view sv) {
+            flag = sv.empty();
+            return true;
+        };
+        check_ = nullptr;
+
+        return *this;
+    }
+
+    template<typename Handler>
+    processor& handle(Handler&& handler) {
+        static constexpr bool takes_string_view = std::is_invocable_v<Handler, std::string_view>;
+        static constexpr bool takes_string = std::is_invocable_v<Handler, std::string>;
+        static constexpr bool takes_void = std::is_invocable_v<Handler>;
+        static_assert(
+            takes_string_view || takes_string || takes_void,
+            "Handler should take std::string_view, std::string or void as the first argument");
+        if constexpr (takes_string_view) {
+            handler_ = [handler{std::forward<Handler>(handler)}](std::string_view arg) mutable {
+                handler(arg);
+                return true;
+            };
+        } else if constexpr (takes_string) {
+            handler_ = [handler{std::forward<Handler>(handler)}](std::string_view arg) mutable {
+                handler(util::str(arg));
+                return true;
+            };
+        } else {
+            handler_ = [handler{std::forward<Handler>(handler)}](std::string_view) mutable {
+                handler();
+                return true;
+            };
+        }
+        check_ = nullptr;
+
+        return *this;
+    }
+
+    template<typename Arg, typename Handler>
+    processor& handle(Handler&& handler) {
+        handler_ = [handler{std::forward<Handler>(handler)}](std::string_view sv) mutable {
+            Arg value;
+            if (!util::try_from_string(sv, value)) {
+                return false;
+            }
+            handler(std::move(value));
+            return true;
+        };
+        check_ = &detail::check_conversion<Arg>;
+        return *this;
+    }
+
+    /*
+     * --ids 1,2,3: appends the elements of every occurrence to dest. Delimiters are found
+     * 16 bytes at a time and dest grows once per occurrence; lists of at least
+     * detail::PARALLEL_LIST_SIZE elements are converted on up to threads threads.
+     * A list with an element that cannot be converted is rejected as a whole.
+     */
+    template<typename T, typename Alloc>
+    processor& store_list(std::vector<T, Alloc>& dest, char delimiter = ',', size_t threads = 1) {
+        handler_ = [&dest, delimiter, threads](std::string_view sv) {
+            return detail::convert_list(sv, delimiter, dest, threads);
+        };
+        check_ = nullptr;
+        reset_ = [&dest](bool restore) {
+            if (restore) {
+                dest.clear();
+            }
+        };
+        return *this;
+    }
+
+    template<
+        typename output_it,
+        std::enable_if_t<std::is_convertible_v<
+            std::output_iterator_tag,
+            typename std::iterator_traits<output_it>::iterator_category>>* = nullptr>
+    processor& append(output_it it) {
+        return append_impl<typename std::iterator_traits<output_it>::value_type>(it);
+    }
+
+    template<typename Container>
+    processor& append(Container& cont) {
+        append_impl<std::decay_t<decltype(*cont.begin())>>(std::back_inserter(cont));
+        reset_ = [&cont](bool restore) {
+            if (restore) {
+                cont.clear();
+            }
+        };
+        reserve_ = [&cont](size_t count) {
+            detail::reserve_more(cont, count);
+        };
+        return *this;
+    }
+
+    /* Called by parser::reset(); store() and append() set it up automatically */
+    template<typename Handler>
+    processor& on_reset(Handler&& handler) {
+        reset_ = [handler{std::forward<Handler>(handler)}](bool restore) mutable {
+            if (restore) {
+                handler();
+            }
+        };
+        return *this;
+    }
+
+    processor& required() {
+        required_ = true;
+        update_defaults_mask();
+        return *this;
+    }
+
+    processor& optional() {
+        required_ = false;
+        update_defaults_mask();
+        return *this;
+    }
+
+    processor& repeatable() {
+        repeatable_ = true;
+        return *this;
+    }
+    
+    processor& no_argument() {
+        has_argument_ = false;
+        return *this;
+    }
+
+    processor& value_type(std::string_view type) {
+        arg_type_ = strings_->intern(type);
+        return *this;
+    }
+
+    template<typename T>
+    processor& default_value(T val) {
+        has_default_value_ = true;
+        default_value_ = strings_->intern(util::to_string(val));
+        if (default_value_.empty()) {
+            throw std::logic_error("Empty default value");
+        }
+        update_defaults_mask();
+        return *this;
+    }
+
+    processor& description(std::string_view descr) {
+        description_ = strings_->intern(descr);
+        return *this;
+    }
+
+private:
+    friend class parser;
+    friend class compiled_parser;
+    friend class parse_result;
+    template<typename T, size_t ChunkSize>
+    friend class detail::stable_storage;
+
+    /* Parsers intern the strings of all their processors in one arena */
+    processor(detail::string_arena* strings, size_t position, std::string_view name)
+        : position_(position)
+        , strings_(strings) {
+        if (util::starts_with(name, "-")) {
+            throw std::logic_error("Option name cannot start with '-'");
+        }
+        if (!strings_) {
+            own_strings_ = std::make_unique<detail::string_arena>();
+            strings_ = own_strings_.get();
+        }
+        lname_ = strings_->intern(name);
+    }
+
+    processor(detail::string_arena* strings, std::string_view lname)
+        : processor(strings, NON_POSITIONAL, lname) {
+    }
+
+    processor(detail::string_arena* strings, char sname, std::string_view lname)
+        : processor(strings, NON_POSITIONAL, lname) {
+        sname_ = sname;
+        if (sname == '-') {
+            throw std::logic_error("Option name cannot start with '-'");
+        }
+    }
+
+    parse_errc parse(std::string_view arg = "") const {
+        if (!handler_) {
+            throw std::logic_error(util::join(
+                "Cannot parse option ",
+                name(),
+                ": the handler was not set. Use either store() or handle()."));
+        }
+        if (arg.empty() && has_argument_) {
+            return parse_errc::argument_required;
+        }
+        return handler_(arg) ? parse_errc::ok : parse_errc::invalid_argument;
+    }
+
+    /*
+     * The value of a store() target is kept by snapshot() at the start of the first parse
+     * (or by the first reset(), whichever comes first) and restored by later resets,
+     * so dest is not read at registration and may be initialized after it.
+     * Small values are kept in the handler, others are allocated by the snapshot.
+     */
+    template<typename Dest>
+    void restore_on_reset(Dest& dest) {
+        if constexpr (std::is_copy_constructible_v<Dest> && std::is_copy_assignable_v<Dest>) {
+            using holder = std::conditional_t<
+                sizeof(std::optional<Dest>) <= 3 * sizeof(void*) &&
+                    std::is_nothrow_move_constructible_v<Dest>,
+                std::optional<Dest>,
+                std::unique_ptr<Dest>>;
+            reset_ = [&dest, initial = holder()](bool restore) mutable {
+                if (initial) {
+                    if (restore) {
+                        dest = *initial;
+                    }
+                } else if constexpr (std::is_same_v<holder, std::optional<Dest>>) {
+                    initial.emplace(dest);
+                } else {
+                    initial = std::make_unique<Dest>(dest);
+                }
+            };
+        } else {
+            reset_ = {};
+        }
+    }
+
+    void reset() const {
+        if (reset_) {
+            reset_(true);
+        }
+    }
+
+    /* Keeps the current value of a store() target for later resets, if not kept yet */
+    void snapshot() const {
+        if (reset_) {
+            reset_(false);
+        }
+    }
+
+    /* Prepares the append() target for count values, see parser::prescan() */
+    void reserve(size_t count) const {
+        if (reserve_) {
+            reserve_(count);
+        }
+    }
+
+    /* Keeps the owning parser's mask of processors that need default_handler() in sync */
+    void attach(size_t index, detail::bitset* defaults_mask) {
+        index_ = index;
+        defaults_mask_ = defaults_mask;
+        update_defaults_mask();
+    }
+
+    void update_defaults_mask() {
+        if (defaults_mask_) {
+            defaults_mask_->set(index_, required_ || has_default_value_);
+        }
+    }
+
+    size_t index() const {
+        return index_;
+    }
+
+    parse_errc default_handler() const {
+        if (required_) {
+            return parse_errc::required_missing;
+        } else if (has_default_value_) {
+            return parse(default_value_);
+        }
+        return parse_errc::ok;
+    }
+
+    std::string_view default_value() const {
+        return default_value_;
+    }
+
+    template<
+        typename arg_t,
+        typename output_it,
+        std::enable_if_t<std::is_convertible_v<
+            std::output_iterator_tag,
+            typename std::iterator_traits<output_it>::iterator_category>>* = nullptr>
+    processor& append_impl(output_it it) {
+        if (!is_repeatable()) {
+            throw std::logic_error(
+                "Cannot use append with non-repeatable processor; call repeatable() before "
+                "append()");
+        }
+
+        return handle<arg_t>([it](arg_t arg) mutable { *(it++) = std::move(arg); });
+    }
+
+    char short_name() const {
+        return sname_;
+    }
+
+    std::string_view long_name() const {
+        return lname_;
+    }
+
+    std::string_view type() const {
+        return arg_type_;
+    }
+
+    bool is_required() const {
+        return required_;
+    }
+
+    bool is_optional() const {
+        return !required_;
+    }
+
+    bool is_positional() const {
+        return position_ != NON_POSITIONAL;
+    }
+
+    bool is_repeatable() const {
+        return repeatable_;
+    }
+
+    bool has_argument() const {
+        return has_argument_;
+    }
+
+    std::string_view name() const {
+        if (lname_.empty()) {
+            /* option has only short name */
+            return std::string_view(&sname_, 1);
+        } else {
+            return lname_;
+        }
+    }
+
+    std::string help() const {
+        std::stringstream result;
+
+        result << detail::OFFSET;
+
+        const bool has_two_names = !lname_.empty() && sname_ != EMPTY_SHORT_NAME;
+
+        if (is_positional()) {
+            result << lname_;
+        } else {
+            if (sname_ != EMPTY_SHORT_NAME) {
+                result << "-" << sname_;
+            }
+            if (has_two_names) {
+                result << ", ";
+            }
+            if (!lname_.empty()) {
+                result << "--" << lname_;
+            }
+        }
+        if (!type().empty()) {
+            result << " <" << type() << ">";
+        }
+        result << '\t';
+        result << description_;
+        if (has_default_value_) {
+            result << " [default = " << default_value_ << "]";
+        }
+        if (is_repeatable()) {
+            result << " (repeatable)";
+        }
+
+        return result.str();
+    }
+
+    std::string usage() const {
+        std::stringstream result;
+
+        if (is_optional()) {
+            result << '[';
+        }
+        if (is_positional()) {
+            result << lname_;
+        } else {
+            if (lname_.empty()) {
+                result << "-" << std::string(1, sname_);
+            } else {
+                result << "--" << lname_;
+            }
+        }
+        if (has_argument_ && !arg_type_.empty()) {
+            result << " <" << arg_type_ << ">";
+        }
+        if (is_optional()) {
+            result << ']';
+        }
+
+        return result.str();
+    }
+
+private:
+    static constexpr char EMPTY_SHORT_NAME = '\0';
+    static constexpr size_t NON_POSITIONAL = std::numeric_limits<size_t>::max();
+
+    bool required_{false};
+    bool repeatable_{false};
+    bool has_default_value_{false};
+    bool has_argument_{true};
+
+    char sname_{EMPTY_SHORT_NAME};
+    std::string_view lname_;
+
+    size_t position_{NON_POSITIONAL};
+
+    size_t index_{0};
+    detail::bitset* defaults_mask_{nullptr};
+    detail::string_arena* strings_{nullptr};
+    /* set only for processors made outside of a parser */
+    std::unique_ptr<detail::string_arena> own_strings_;
+
+    std::string_view arg_type_;
+    std::string_view description_;
+    std::string_view default_value_;
+
+    /* returns false if the argument cannot be converted */
+    detail::inline_function<bool(std::string_view)> handler_;
+    /* validates the argument without the handler, set when the value type is known */
+    bool (*check_)(std::string_view){nullptr};
+    /* restore == false asks store() targets for a snapshot, see restore_on_reset() */
+    detail::inline_function<void(bool restore)> reset_;
+    detail::inline_function<void(size_t)> reserve_;
+};
+
+class invalid_free_arguments_count : public processor_error {
+public:
+    invalid_free_arguments_count(size_t count, size_t maximum)
+        : processor_error(util::join(
+              "Invalid free arguments count, got ",
+              count,
+              " while maximum is ",
+              maximum)) {
+    }
+};
+
+class free_args_processor {
+public:
+    free_args_processor() = default;
+
+    free_args_processor& max(size_t count) {
+        max_count_ = count;
+        return *this;
+    }
+
+    free_args_processor& unlimited() {
+        return max(UNLIMITED);
+    }
+
+    template<typename Handler>
+    free_args_processor& handle(Handler&& handler) {
+        static_assert(
+            std::is_invocable_v<Handler, const std::vector<std::string_view>&>,
+            "Handler should take std::vector<std::string_view> as the first argument");
+        handler_ = [handler{std::forward<Handler>(handler)}](
+                       const std::vector<std::string_view>& args) mutable {
+            handler(args);
+            return args.size();
+        };
+        check_ = nullptr;
+        return *this;
+    }
+
+    template<typename T>
+    free_args_processor& store(std::vector<T>& free_args) {
+        handler_ = [&free_args](const std::vector<std::string_view>& args) {
+            for (size_t i = 0; i < args.size(); ++i) {
+                T value;
+                if (!util::try_from_string(args[i], value)) {
+                    return i;
+                }
+                free_args.push_back(std::move(value));
+            }
+            return args.size();
+        };
+        reset_ = [&free_args] {
+            free_args.clear();
+        };
+        reserve_ = [&free_args](size_t count) {
+            detail::reserve_more(free_args, count);
+        };
+        check_ = &detail::check_conversion<T>;
+        return *this;
+    }
+
+    /* Called by parser::reset(); store() sets it up automatically */
+    template<typename Handler>
+    free_args_processor& on_reset(Handler&& handler) {
+        reset_ = std::forward<Handler>(handler);
+        return *this;
+    }
+
+    void reset() const {
+        if (reset_) {
+            reset_();
+        }
+    }
+
+    void reserve(size_t count) const {
+        if (reserve_) {
+            reserve_(count);
+        }
+    }
+
+    free_args_processor& name(std::string_view name) {
+        name_ = util::str(name);
+        return *this;
+    }
+
+    /* On invalid_argument, rejected is set to the index of the argument that cannot be converted */
+    parse_errc parse(const std::vector<std::string_view>& args, size_t& rejected) const {
+        if (args.size() > max_count_) {
+            return parse_errc::too_many_free_arguments;
+        }
+        if (handler_) {
+            rejected = handler_(args);
+            if (rejected != args.size()) {
+                return parse_errc::invalid_argument;
+            }
+        }
+        return parse_errc::ok;
+    }
+
+    size_t max_count() const {
+        return max_count_;
+    }
+
+    std::string usage() const {
+        if (max_count() > 0) {
+            return util::join(name_, "...");
+        } else {
+            return "";
+        }
+    }
+
+    std::string help() const {
+        if (max_count() > 0) {
+            return util::join(name_, "...");
+        } else {
+            return "";
+        }
+    }
+
+private:
+    friend class compiled_parser;
+
+    static constexpr size_t UNLIMITED = std::numeric_limits<size_t>::max();
+
+    size_t max_count_{0};
+    std::string name_;
+    /* returns the index of the first argument that cannot be converted, or args.size() */
+    detail::inline_function<size_t(const std::vector<std::string_view>&)> handler_;
+    /* validates one argument without the handler, set by store() */
+    bool (*check_)(std::string_view){nullptr};
+    detail::inline_function<void()> reset_;
+    detail::inline_function<void(size_t)> reserve_;
+};
+
+inline std::string parse_result::message() const {
+    const std::string_view option = source_ ? source_->name() : option_name_;
+
+    switch (error_) {
+    case parse_errc::ok:
+        return "";
+    case parse_errc::unknown_option:
+        if (std::string_view suggestion = suggest(); !suggestion.empty()) {
+            return util::join("Unknown option ", token_, ". Did you mean --", suggestion, "?");
+        }
+        return util::join("Unknown option ", token_, ".");
+    case parse_errc::ambiguous_option:
+        return util::join(
+            "Ambiguous option ",
+            token_,
+            candidates_ ? util::join(": ", candidates_(names_source_, token_)) : "",
+            ".");
+    case parse_errc::argument_required:
+        return util::join("Cannot parse option ", option, ": argument required.");
+    case parse_errc::invalid_argument:
+        if (!option.empty()) {
+            return util::join("Cannot parse option ", option, ": invalid value '", token_, "'.");
+        }
+        return util::join("Cannot parse free argument '", token_, "'.");
+    case parse_errc::not_repeatable:
+        return util::join("Option '", token_, "' is not repeatable");
+    case parse_errc::required_missing:
+        return util::join("Option ", option, " is required.");
+    case parse_errc::too_many_free_arguments:
+        return util::join(
+            "Invalid free arguments count, got ", count_, " while maximum is ", max_count_);
+    case parse_errc::command_required:
+        if (!command_path_.empty()) {
+            return util::join("Command name is required after '", command_path_, "'.");
+        }
+        return "Command name is required.";
+    case parse_errc::unknown_command: {
+        std::string result = util::join("Unknown command '", token_, "'");
+        if (!command_path_.empty()) {
+            result += util::join(" after '", command_path_, "'");
+        }
+        result += '.';
+        if (std::string_view suggestion = suggest(); !suggestion.empty()) {
+            result += util::join(" Did you mean '", suggestion, "'?");
+        }
+        return result;
+    }
+    case parse_errc::handler_error:
+        return handler_message_;
+    case parse_errc::response_file_error:
+        return util::join("Cannot read response file '", token_, "'.");
+    }
+    return "";
+}
+
+inline void parse_result::raise() const {
+    switch (error_) {
+    case parse_errc::too_many_free_arguments:
+        throw invalid_free_arguments_count(count_, max_count_);
+    case parse_errc::command_required:
+    case parse_errc::unknown_command:
+    case parse_errc::handler_error:
+    case parse_errc::response_file_error:
+        throw parser_error(message());
+    default:
+        throw processor_error(message());
+    }
+}
+
+namespace detail {
+
+/*
+ * Private writable view of a file: memory-mapped copy-on-write where available,
+ * so tokenizing in place touches only the pages that are actually modified.
+ */
+class mapped_file {
+public:
+    /* returns nullptr if the file cannot be read */
+    static std::shared_ptr<mapped_file> open(const std::string& path) {
+        auto result = std::make_shared<mapped_file>();
+#if defined(_WIN32)
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return nullptr;
+        }
+        result->buffer_.assign(std::istreambuf_iterator<char>(in), {});
+        result->data_ = result->buffer_.data();
+        result->size_ = result->buffer_.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        /* pipes and /proc files report no size, so only regular files are mapped */
+        if (S_ISREG(info.st_mode) && info.st_size > 0) {
+            result->size_ = static_cast<size_t>(info.st_size);
+            void* data =
+                ::mmap(nullptr, result->size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                return nullptr;
+            }
+            result->data_ = static_cast<char*>(data);
+            result->mapped_ = true;
+        } else {
+            char chunk[4096];
+            ssize_t read;
+            while ((read = ::read(fd, chunk, sizeof(chunk))) != 0) {
+                if (read < 0 && errno != EINTR) {
+                    ::close(fd);
+                    return nullptr;
+                }
+                if (read > 0) {
+                    result->buffer_.append(chunk, static_cast<size_t>(read));
+                }
+            }
+            result->data_ = result->buffer_.data();
+            result->size_ = result->buffer_.size();
+        }
+        ::close(fd);
+#endif
+        return result;
+    }
+
+    mapped_file() = default;
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file() {
+#if !defined(_WIN32)
+        if (mapped_) {
+            ::munmap(data_, size_);
+        }
+#endif
+    }
+
+    char* data() {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    char* data_{nullptr};
+    size_t size_{0};
+    /* contents of files that are not mapped */
+    std::string buffer_;
+    bool mapped_{false};
+};
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+/* bytes of chunk that are whitespace, quotes or backslashes */
+inline int shell_special_mask(__m128i chunk) {
+    /* '\t' ... '\r' are the only whitespace characters below ' ' */
+    const __m128i shifted = _mm_sub_epi8(chunk, _mm_set1_epi8('\t'));
+    const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+    __m128i special = _mm_or_si128(control, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\'')));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\')));
+    return _mm_movemask_epi8(special);
+}
+
+/* bytes of chunk that end a double-quoted run */
+inline int double_quoted_special_mask(__m128i chunk) {
+    return _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))));
+}
+
+/* Scans 16 bytes at a time, the tail is checked with the scalar predicate */
+template<typename Mask, typename Predicate>
+char* find_first(char* first, char* last, Mask mask, Predicate predicate) {
+    while (last - first >= 16) {
+        if (int bits = mask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first)))) {
+            return first + count_trailing_zeros(static_cast<uint64_t>(bits));
+        }
+        first += 16;
+    }
+    return std::find_if(first, last, predicate);
+}
+
+/* Calls callback(position) for every c in s, in order, while it returns true */
+template<typename Callback>
+bool for_each_char(std::string_view s, char c, Callback&& callback) {
+    const __m128i pattern = _mm_set1_epi8(c);
+    size_t base = 0;
+    for (; base + 16 <= s.size(); base += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.data() + base));
+        uint64_t bits = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern)));
+        for (; bits; bits &= bits - 1) {
+            if (!callback(base + count_trailing_zeros(bits))) {
+                return false;
+            }
+        }
+    }
+    for (; base < s.size(); ++base) {
+        if (s[base] == c && !callback(base)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#else
+
+template<typename Mask, typename Predicate>
+char* find_first(char* first, char* last, Mask, Predicate predicate) {
+    return std::find_if(first, last, predicate);
+}
+
+template<typename Callback>
+bool for_each_char(std::string_view s, char c, Callback&& callback) {
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == c && !callback(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline int shell_special_mask(int) {
+    return 0;
+}
+
+inline int double_quoted_special_mask(int) {
+    return 0;
+}
+
+#endif
+
+inline bool is_shell_special(char c) {
+    return util::detail::is_space(c) || c == '\'' || c == '"' || c == '\\';
+}
+
+/*
+ * Splits [first, last) into arguments with POSIX shell quoting:
+ * whitespace separates arguments, single quotes keep everything literally,
+ * inside double quotes a backslash escapes only $, `, ", \ and newline,
+ * outside of quotes it escapes any character; backslash-newline is removed.
+ * Arguments are unquoted in place, plain arguments are not written to.
+ * With terminate, every argument is followed by '\0', which needs one writable byte after last.
+ * Returns false if a quote is not closed.
+ */
+inline bool split_in_place(
+    char* first, char* last, std::vector<std::string_view>& tokens, bool terminate = false) {
+    char* pos = first;
+    while (true) {
+        while (pos != last && util::detail::is_space(*pos)) {
+            ++pos;
+        }
+        if (pos == last) {
+            return true;
+        }
+
+        char* const begin = pos;
+        char* out = pos;
+        auto copy = [&out](char* from, char* to) {
+            if (out != from) {
+                std::memmove(out, from, to - from);
+            }
+            out += to - from;
+        };
+
+        while (pos != last) {
+            char* special = find_first(pos, last, shell_special_mask, is_shell_special);
+            copy(pos, special);
+            pos = special;
+            if (pos == last || util::detail::is_space(*pos)) {
+                break;
+            }
+
+            const char c = *pos++;
+            if (c == '\\') {
+                if (pos == last) {
+                    *out++ = c;
+                } else if (*pos == '\n') {
+                    ++pos;
+                } else {
+                    *out++ = *pos++;
+                }
+            } else if (c == '\'') {
+                char* close = std::find(pos, last, '\'');
+                if (close == last) {
+                    return false;
+                }
+                copy(pos, close);
+                pos = close + 1;
+            } else {
+                while (true) {
+                    char* stop = find_first(pos, last, double_quoted_special_mask, [](char ch) {
+                        return ch == '"' || ch == '\\';
+                    });
+                    copy(pos, stop);
+                    pos = stop;
+                    if (pos == last) {
+                        return false;
+                    }
+                    if (*pos++ == '"') {
+                        break;
+                    }
+                    if (pos == last) {
+                        return false;
+                    }
+                    if (*pos == '\n') {
+                        ++pos;
+                    } else if (*pos == '$' || *pos == '`' || *pos == '"' || *pos == '\\') {
+                        *out++ = *pos++;
+                    } else {
+                        *out++ = '\\';
+                    }
+                }
+            }
+        }
+
+        tokens.emplace_back(begin, out - begin);
+        if (pos != last) {
+            /* the separator, which may be overwritten by the terminator */
+            ++pos;
+        }
+        if (terminate) {
+            *out = '\0';
+        }
+    }
+}
+
+/*
+ * Threads kept for parallel_for: started by the first call that needs them and reused by
+ * the later ones, so a call wakes threads up instead of starting them. Concurrent and
+ * nested calls share the threads. The caller of a job runs it as well and withdraws
+ * the workers no thread has taken yet, so it never waits for threads busy with other jobs.
+ */
+class worker_pool {
+public:
+    /* run(context, worker) for workers 1 .. workers - 1; the caller is worker 0 */
+    struct job {
+        void (*run)(void* context, size_t worker);
+        void* context;
+        size_t workers;
+        /* guarded by the pool mutex */
+        size_t next_worker{1};
+        size_t running{0};
+    };
+
+    /* Never destroyed: the threads sleep until the process exits */
+    static worker_pool& instance() {
+        static worker_pool* pool = new worker_pool;
+        return *pool;
+    }
+
+    /* Offers the workers of the job to the threads, starting more threads if there are few */
+    void submit(job& j) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (threads_ + 1 < j.workers) {
+                std::thread([this] {
+                    serve();
+                }).detach();
+                ++threads_;
+            }
+            pending_.push_back(&j);
+        }
+        wake_.notify_all();
+    }
+
+    /* Withdraws the workers that were not taken and waits for the taken ones to return */
+    void finish(job& j) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_.erase(std::remove(pending_.begin(), pending_.end(), &j), pending_.end());
+        done_.wait(lock, [&j] {
+            return j.running == 0;
+        });
+    }
+
+private:
+    worker_pool() = default;
+
+    void serve() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] {
+                return !pending_.empty();
+            });
+            job& j = *pending_.front();
+            const size_t worker = j.next_worker++;
+            if (j.next_worker == j.workers) {
+                pending_.erase(pending_.begin());
+            }
+            ++j.running;
+            lock.unlock();
+            j.run(j.context, worker);
+            lock.lock();
+            if (--j.running == 0) {
+                done_.notify_all();
+            }
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::vector<job*> pending_;
+    size_t threads_{0};
+};
+
+/*
+ * Calls body(worker, i) for every i in [0, count) on the given number of workers,
+ * the calling thread being worker 0 and the others threads of worker_pool.
+ * Every worker owns a range of indices and takes small chunks from its front;
+ * a worker that runs out steals the back half of another's range.
+ */
+template<typename Body>
+void parallel_for(size_t count, size_t workers, Body&& body) {
+    /* [begin, end) packed into one word, so taking and stealing are single CASes */
+    auto pack = [](uint64_t begin, uint64_t end) {
+        return begin << 32 | end;
+    };
+    auto begin_of = [](uint64_t range) {
+        return range >> 32;
+    };
+    auto end_of = [](uint64_t range) {
+        return range & 0xffffffffull;
+    };
+
+    if (count > 0xffffffffull) {
+        throw std::logic_error("parallel_for supports up to 2^32 - 1 indices");
+    }
+    workers = std::max<size_t>(1, std::min(workers, count));
+    const uint64_t chunk = std::clamp<uint64_t>(count / (workers * 16), 1, 64);
+
+    struct alignas(64) range {
+        std::atomic<uint64_t> value{0};
+    };
+    std::vector<range> ranges(workers);
+    for (size_t w = 0; w < workers; ++w) {
+        ranges[w].value = pack(count * w / workers, count * (w + 1) / workers);
+    }
+
+    auto run = [&](size_t worker) {
+        std::atomic<uint64_t>& own = ranges[worker].value;
+        while (true) {
+            uint64_t current = own.load();
+            if (begin_of(current) < end_of(current)) {
+                const uint64_t first = begin_of(current);
+                const uint64_t last = std::min<uint64_t>(first + chunk, end_of(current));
+                if (own.compare_exchange_weak(current, pack(last, end_of(current)))) {
+                    for (uint64_t i = first; i < last; ++i) {
+                        body(worker, static_cast<size_t>(i));
+                    }
+                }
+                continue;
+            }
+
+            /* ranges only shrink, so a pass that finds nothing to steal means the work is done */
+            bool stolen = false;
+            for (size_t offset = 1; offset < workers && !stolen; ++offset) {
+                std::atomic<uint64_t>& victim = ranges[(worker + offset) % workers].value;
+                uint64_t target = victim.load();
+                while (begin_of(target) < end_of(target)) {
+                    const uint64_t half = (end_of(target) - begin_of(target) + 1) / 2;
+                    const uint64_t split = end_of(target) - half;
+                    if (victim.compare_exchange_weak(target, pack(begin_of(target), split))) {
+                        own.store(pack(split, split + half));
+                        stolen = true;
+                        break;
+                    }
+                }
+            }
+            if (!stolen) {
+                return;
+            }
+        }
+    };
+
+    if (workers == 1) {
+        run(0);
+        return;
+    }
+    auto call = [](void* context, size_t worker) {
+        (*static_cast<decltype(run)*>(context))(worker);
+    };
+    worker_pool::job job{call, &run, workers};
+    worker_pool& pool = worker_pool::instance();
+    pool.submit(job);
+    try {
+        run(0);
+    } catch (...) {
+        pool.finish(job);
+        throw;
+    }
+    pool.finish(job);
+}
+
+/* Lists shorter than this are converted on the calling thread, see processor::store_list() */
+inline constexpr size_t PARALLEL_LIST_SIZE = 1 << 14;
+
+/* Appends the elements of a delimited list to dest; dest is left as it was on failure */
+template<typename T, typename Alloc>
+bool convert_list(
+    std::string_view list,
+    char delimiter,
+    std::vector<T, Alloc>& dest,
+    size_t threads) {
+    size_t count = 1;
+    for_each_char(list, delimiter, [&count](size_t) {
+        ++count;
+        return true;
+    });
+    const size_t old_size = dest.size();
+    auto rollback = [&dest, old_size] {
+        dest.erase(dest.begin() + static_cast<std::ptrdiff_t>(old_size), dest.end());
+        return false;
+    };
+    /* geometric, so a list option repeated many times does not reallocate on every one */
+    if (dest.capacity() < old_size + count) {
+        dest.reserve(std::max(old_size + count, 2 * dest.capacity()));
+    }
+
+    /* elements of std::vector<bool> share words, so they cannot be written concurrently */
+    if constexpr (!std::is_same_v<T, bool>) {
+        if (threads > 1 && count >= PARALLEL_LIST_SIZE) {
+            std::vector<std::string_view> items;
+            items.reserve(count);
+            size_t start = 0;
+            for_each_char(list, delimiter, [&](size_t position) {
+                items.push_back(list.substr(start, position - start));
+                start = position + 1;
+                return true;
+            });
+            items.push_back(list.substr(start));
+
+            dest.resize(old_size + count);
+            /*
+             * Elements after a failed one are skipped, the ones before it are all converted,
+             * so the list fails on its first bad element, as it does on one thread:
+             * with false or with the exception of that element.
+             */
+            std::atomic<size_t> first_failed{count};
+            /* an exception escaping a worker thread would terminate the process */
+            std::vector<std::pair<size_t, std::exception_ptr>> errors(threads, {count, nullptr});
+            parallel_for(count, threads, [&](size_t worker, size_t i) {
+                if (i > first_failed.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                bool converted = false;
+                try {
+                    converted = util::try_from_string(items[i], dest[old_size + i]);
+                } catch (...) {
+                    if (i < errors[worker].first) {
+                        errors[worker] = {i, std::current_exception()};
+                    }
+                }
+                size_t failed = first_failed.load(std::memory_order_relaxed);
+                while (!converted && i < failed &&
+                       !first_failed.compare_exchange_weak(failed, i, std::memory_order_relaxed)) {
+                }
+            });
+            if (first_failed.load() == count) {
+                return true;
+            }
+            rollback();
+            for (const auto& [index, error] : errors) {
+                if (index == first_failed.load()) {
+                    std::rethrow_exception(error);
+                }
+            }
+            return false;
+        }
+    }
+
+    size_t start = 0;
+    auto convert = [&](std::string_view item) {
+        T value;
+        if (!util::try_from_string(item, value)) {
+            return false;
+        }
+        dest.push_back(std::move(value));
+        return true;
+    };
+    try {
+        const bool converted = for_each_char(list, delimiter, [&](size_t position) {
+            const std::string_view item = list.substr(start, position - start);
+            start = position + 1;
+            return convert(item);
+        });
+        return converted && convert(list.substr(start)) ? true : rollback();
+    } catch (...) {
+        rollback();
+        throw;
+    }
+}
+
+/* Command line seen by the parser: argv itself or argv with response files expanded */
+class token_list {
+public:
+    explicit token_list(const char* argv[])
+        : argv_(argv) {
+        while (argv_[size_]) {
+            ++size_;
+        }
+    }
+
+    explicit token_list(const std::vector<std::string_view>& tokens)
+        : tokens_(&tokens)
+        , size_(tokens.size()) {
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    std::string_view operator[](size_t i) const {
+        return tokens_ ? (*tokens_)[i] : argv_[i];
+    }
+
+    /* index of a token that was taken from the list without copying */
+    size_t index_of(std::string_view token) const {
+        for (size_t i = 1; i < size_; ++i) {
+            if ((*this)[i].data() == token.data()) {
+                return i;
+            }
+        }
+        return parse_result::NO_TOKEN;
+    }
+
+private:
+    const char** argv_{nullptr};
+    const std::vector<std::string_view>* tokens_{nullptr};
+    size_t size_{0};
+};
+
+/*
+ * Classifies one token, once. Names and values are views into the token:
+ *
+ *   --name, --name=value      long_name; value() is set for the second form
+ *   -abc, -ofile              short_name; name() is the whole cluster "abc" / "ofile"
+ *   --                        free_arg_delimiter
+ *   value, -, -5, -.5         positional or free_arg, see make_value() for negative numbers
+ */
+class argument_parser {
+public:
+    enum class arg_type { positional, short_name, long_name, free_arg, free_arg_delimiter };
+
+    argument_parser(std::string_view arg, size_t position, size_t positional_count)
+        : arg_(arg)
+        , name_(arg)
+        , can_be_positional_(position < positional_count) {
+        if (arg.size() < 2 || arg[0] != '-') {
+            make_value();
+        } else if (arg[1] != '-') {
+            type_ = arg_type::short_name;
+            name_ = arg.substr(1);
+        } else if (arg.size() == 2) {
+            /* ./command ... -- free args */
+            type_ = arg_type::free_arg_delimiter;
+        } else {
+            type_ = arg_type::long_name;
+            name_ = arg.substr(2);
+            if (size_t eq = name_.find('='); eq != std::string_view::npos) {
+                value_ = name_.substr(eq + 1);
+                has_value_ = true;
+                name_ = name_.substr(0, eq);
+            }
+        }
+    }
+
+    arg_type type() const {
+        return type_;
+    }
+
+    std::string_view name() const {
+        return name_;
+    }
+
+    /* --name=value */
+    bool has_value() const {
+        return has_value_;
+    }
+
+    std::string_view value() const {
+        return value_;
+    }
+
+    /* -5, -.5: a value, unless the parser has a short option named by the digit */
+    bool is_negative_number() const {
+        return type_ == arg_type::short_name && starts_with_digit(name_);
+    }
+
+    /* Treats the token as a value: a positional argument if one is pending, a free one otherwise */
+    void make_value() {
+        type_ = can_be_positional_ ? arg_type::positional : arg_type::free_arg;
+        name_ = arg_;
+    }
+
+    /*
+     * Whether the token following an option can be its value: anything but another option.
+     * is_short(char) tells whether the parser has a short option, which -5 then names.
+     */
+    template<typename IsShort>
+    static bool is_value(std::string_view token, IsShort&& is_short) {
+        return token.size() < 2 || token[0] != '-' ||
+            (starts_with_digit(token.substr(1)) && !is_short(token[1]));
+    }
+
+private:
+    static bool starts_with_digit(std::string_view s) {
+        auto is_digit = [](char c) {
+            return c >= '0' && c <= '9';
+        };
+        return !s.empty() && (is_digit(s[0]) || (s.size() > 1 && s[0] == '.' && is_digit(s[1])));
+    }
+
+private:
+    std::string_view arg_;
+    std::string_view name_;
+    std::string_view value_;
+    arg_type type_{arg_type::free_arg};
+    bool has_value_{false};
+    bool can_be_positional_;
+};
+
+/*
+ * Splits tokens into options, positional and free arguments; the grammar of every parser.
+ * Options are identified by keys of Source, the parser whose options are looked up:
+ *
+ *   find_long(name, ambiguous), find_short(name)    the key of the option or Source::NOT_FOUND
+ *   has_argument(key), long_name(key)
+ *   fail(result, error, token_index, token, key)     reports an error of the option
+ *   describe_names(result)                           lets result suggest names for a typo
+ *
+ * positionals are the keys of the positional arguments in order.
+ * on_option(key, option_index, name, arg, token_index) is called for each option and
+ * positional argument, on_free_arg(token, token_index) for each free argument.
+ * Stops on the first callback that returns false and on an option that cannot be found
+ * or gets a value it does not take, which is reported through result.
+ * Returns whether all tokens were walked.
+ */
+struct token_walker {
+    template<typename Source, typename Positionals, typename OnOption, typename OnFreeArg>
+    static bool walk(
+        const Source& source,
+        const token_list& tokens,
+        const Positionals& positionals,
+        parse_result& result,
+        OnOption&& on_option,
+        OnFreeArg&& on_free_arg) {
+        size_t next_positional = 0;
+        bool was_free_arg_delimiter = false;
+        auto is_short = [&source](char name) {
+            return source.find_short(name) != Source::NOT_FOUND;
+        };
+
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            if (was_free_arg_delimiter) {
+                if (!on_free_arg(tokens[i], i)) {
+                    return false;
+                }
+                continue;
+            }
+
+            argument_parser arg_parser(tokens[i], next_positional, positionals.size());
+            if (arg_parser.is_negative_number() && !is_short(arg_parser.name()[0])) {
+                arg_parser.make_value();
+            }
+
+            const size_t option_index = i;
+            std::string_view name = arg_parser.name();
+            switch (arg_parser.type()) {
+            case argument_parser::arg_type::free_arg:
+                if (!on_free_arg(name, i)) {
+                    return false;
+                }
+                break;
+            case argument_parser::arg_type::free_arg_delimiter:
+                was_free_arg_delimiter = true;
+                break;
+            case argument_parser::arg_type::positional:
+                if (!on_option(positionals[next_positional++], i, name, name, i)) {
+                    return false;
+                }
+                break;
+            case argument_parser::arg_type::long_name: {
+                bool ambiguous = false;
+                const auto key = source.find_long(name, ambiguous);
+                if (key == Source::NOT_FOUND) {
+                    result.fail(
+                        ambiguous ? parse_errc::ambiguous_option : parse_errc::unknown_option,
+                        i,
+                        name);
+                    source.describe_names(result);
+                    return false;
+                }
+                name = source.long_name(key);
+                std::string_view arg = arg_parser.value();
+                if (arg_parser.has_value() && !source.has_argument(key)) {
+                    source.fail(result, parse_errc::invalid_argument, i, arg, key);
+                    return false;
+                }
+                if (!arg_parser.has_value() && source.has_argument(key) && i + 1 < tokens.size() &&
+                    argument_parser::is_value(tokens[i + 1], is_short)) {
+                    arg = tokens[++i];
+                }
+                if (!on_option(key, option_index, name, arg, i)) {
+                    return false;
+                }
+                break;
+            }
+            case argument_parser::arg_type::short_name:
+                /* -abc is -a -b -c until an option that takes the rest as its value: -ofile */
+                for (size_t k = 0; k < name.size(); ++k) {
+                    const std::string_view option_name = name.substr(k, 1);
+                    const auto key = source.find_short(name[k]);
+                    if (key == Source::NOT_FOUND) {
+                        result.fail(parse_errc::unknown_option, i, option_name);
+                        /* several letters may be a long option typed with one dash */
+                        if (name.size() > 1) {
+                            source.describe_names(result);
+                            result.typo_ = name;
+                        }
+                        return false;
+                    }
+                    std::string_view arg = "";
+                    if (source.has_argument(key)) {
+                        arg = name.substr(k + 1);
+                        if (arg.empty() && i + 1 < tokens.size() &&
+                            argument_parser::is_value(tokens[i + 1], is_short)) {
+                            arg = tokens[++i];
+                        }
+                        k = name.size();
+                    }
+                    if (!on_option(key, option_index, option_name, arg, i)) {
+                        return false;
+                    }
+                }
+                break;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace detail
+
+/*
+ * Splits a command line given as one string, see detail::split_in_place for the quoting rules:
+ *
+ *   cpparg::command_line line("./program --name 'quoted value'");
+ *   parser.parse(line.argc(), line.argv());
+ *
+ * The first argument is the program name. Buffers are reused by later split() calls,
+ * which invalidate the views and argv returned before.
+ */
+class command_line {
+public:
+    command_line() = default;
+
+    explicit command_line(std::string_view line) {
+        split(line);
+    }
+
+    /* Throws parser_error if a quote is not closed */
+    command_line& split(std::string_view line) {
+        args_.clear();
+        argv_.clear();
+        /* one more byte for the terminator of the last argument */
+        buffer_.resize(line.size() + 1);
+        std::copy(line.begin(), line.end(), buffer_.begin());
+
+        char* first = buffer_.data();
+        if (!detail::split_in_place(first, first + line.size(), args_, true)) {
+            args_.clear();
+            throw parser_error(util::join("Unterminated quote in command line '", line, "'"));
+        }
+
+        for (std::string_view arg : args_) {
+            argv_.push_back(arg.data());
+        }
+        argv_.push_back(nullptr);
+        return *this;
+    }
+
+    int argc() const {
+        return static_cast<int>(args_.size());
+    }
+
+    /* null-terminated, as in main() */
+    const char** argv() {
+        return argv_.data();
+    }
+
+    const std::vector<std::string_view>& args() const {
+        return args_;
+    }
+
+    size_t size() const {
+        return args_.size();
+    }
+
+    std::string_view operator[](size_t i) const {
+        return args_[i];
+    }
+
+private:
+    /* unquoted arguments separated by '\0'; a vector keeps its data on moves */
+    std::vector<char> buffer_;
+    std::vector<std::string_view> args_;
+    std::vector<const char*> argv_{nullptr};
+};
+
+class compiled_parser;
+
+class parser : public detail::parser_base<parser> {
+public:
+    parser(std::string_view program)
+        : program_(util::str(program)) {
+    }
+
+    processor& add(std::string_view lname) {
+        return create_processor(lname);
+    }
+
+    processor& add(char sname, std::string_view lname = "") {
+        return create_processor(sname, lname);
+    }
+
+    processor& positional(std::string_view name) {
+        processor& result = register_processor(positional_.size(), name);
+        positional_.push_back(&result);
+        return result;
+    }
+
+    free_args_processor& free_arguments(std::string_view name) {
+        return free_args_processor_.name(name);
+    }
+
+    parser& add_help(char sname, std::string_view lname = "") {
+        if (help_) {
+            throw std::logic_error("Cannot add two help options");
+        }
+
+        processor& result = create_processor(sname, lname);
+        result.no_argument().description("Print this help and exit").handle([this](std::string_view) {
+            exit_with_help("", 0);
+        });
+
+        help_ = &result;
+
+        return *this;
+    }
+
+    /*
+     * Brings store() targets, append() containers and free arguments to their initial state.
+     * store() targets get back the value they had before the first parse.
+     */
+    void reset() const {
+        for (size_t i = 0; i < processors_.size(); ++i) {
+            processors_[i].reset();
+        }
+        free_args_processor_.reset();
+    }
+
+    /* Parses another command line with the same parser, see reset() */
+    int reparse(
+        int argc, const char* argv[], parsing_error_policy err = parsing_error_policy::exit) const {
+        reset();
+        return parse(argc, argv, err);
+    }
+
+    parse_result try_reparse(int argc, const char* argv[]) const {
+        reset();
+        return try_parse(argc, argv);
+    }
+
+    /*
+     * Read-only copy of the options for parsing on many threads, see compiled_parser.
+     * With validate == false typed arguments are not checked while parsing,
+     * they are converted by compiled_parser::arguments::get on first access instead.
+     */
+    compiled_parser compile(bool validate = true) const;
+
+    /*
+     * Writes the options that complete the last of words, one per line.
+     * Nothing is written for words that do not start with '-' or that are values of
+     * the previous option, so the shell falls back to its default completion.
+     * Handlers are not called.
+     */
+    void complete(const std::vector<std::string_view>& words, std::ostream& out) const {
+        const std::string_view current = words.empty() ? "" : words.back();
+        if (words.size() > 1 && takes_argument(words[words.size() - 2])) {
+            return;
+        }
+        if (!util::starts_with(current, "-")) {
+            return;
+        }
+
+        /* long names come from the sorted index, as command names do */
+        if (current.size() == 1 || current[1] == '-') {
+            long_.for_each(current.substr(std::min<size_t>(current.size(), 2)), [&out](auto name) {
+                out << "--" << name << '\n';
+            });
+        }
+        if (current.size() > 2) {
+            return;
+        }
+        std::vector<char> shorts;
+        for (const auto& [name, p] : short_) {
+            if (current.size() == 1 || current[1] == name) {
+                shorts.push_back(name);
+            }
+        }
+        std::sort(shorts.begin(), shorts.end());
+        for (char name : shorts) {
+            out << '-' << name << '\n';
+        }
+    }
+
+    int parse_impl(int argc, const char* argv[]) const {
+        parse_result result;
+        parse_core(argc, argv, result);
+        if (!result) {
+            result.raise();
+        }
+        return result.value();
+    }
+
+    /*
+     * Expands @path arguments into the whitespace-separated arguments of the file.
+     * Files are memory-mapped and the arguments are views into the mapping,
+     * which is kept alive by the parser until the next parse and by the parse_result.
+     * Token indices reported in parse_result then refer to the expanded command line.
+     */
+    parser& response_files(bool enabled = true) {
+        response_files_ = enabled;
+        return *this;
+    }
+
+    /*
+     * Lets a long option be given by any prefix that matches it alone, as getopt_long does:
+     * --verb for --verbose. A prefix of several names is an ambiguous_option error.
+     * Exact names are looked up first and cost the same either way. Disabled by default.
+     */
+    parser& abbreviations(bool enabled = true) {
+        abbreviations_ = enabled;
+        return *this;
+    }
+
+    /*
+     * Counts the options and free arguments before parsing and reserves room in append()
+     * containers, the free_args().store() vector and the internal free argument list,
+     * so a command line with thousands of repeated values allocates each of them once.
+     * Costs one more pass over argv, which is more than the reallocations of cheap values save:
+     * use it to bound allocations and peak memory, not for speed. Disabled by default.
+     */
+    parser& prescan(bool enabled = true) {
+        prescan_ = enabled;
+        return *this;
+    }
+
+    /* Reports invalid input through result instead of throwing */
+    void parse_core(int, const char* argv[], parse_result& result) const {
+        /* scratch buffers keep their capacity between parses */
+        std::vector<std::string_view>& free_args = scratch_.free_args;
+        free_args.clear();
+        detail::bitset& seen = scratch_.seen;
+        seen.assign(processors_.size());
+
+        if (!snapshot_taken_) {
+            for (size_t i = 0; i < processors_.size(); ++i) {
+                processors_[i].snapshot();
+            }
+            snapshot_taken_ = true;
+        }
+
+        detail::token_list tokens(argv);
+        if (response_files_ && !expand_response_files(tokens, result)) {
+            return;
+        }
+
+        if (prescan_) {
+            reserve_for(tokens);
+        }
+
+        /* runs the processor of the option found in token option_index */
+        auto apply = [&](const processor* p, size_t option_index, std::string_view name,
+                         std::string_view arg, size_t i) {
+            result.at(i, arg, p);
+            if (parse_errc error = p->parse(arg); error != parse_errc::ok) {
+                result.fail(error, i, arg, p);
+                return false;
+            }
+            if (seen.test(p->index()) && !p->is_repeatable()) {
+                result.fail(parse_errc::not_repeatable, option_index, name, p);
+                return false;
+            }
+            seen.set(p->index());
+            return true;
+        };
+        auto add_free_arg = [&free_args](std::string_view arg, size_t) {
+            free_args.push_back(arg);
+            return true;
+        };
+        if (!detail::token_walker::walk(*this, tokens, positional_, result, apply, add_free_arg)) {
+            return;
+        }
+
+        /* only processors that are required or have default values need a second look */
+        for (size_t w = 0; w < seen.word_count(); ++w) {
+            uint64_t pending = context_->defaults.word(w) & ~seen.word(w);
+            while (pending) {
+                const size_t bit = detail::count_trailing_zeros(pending);
+                const processor& p = processors_[w * detail::bitset::WORD_BITS + bit];
+                result.at(parse_result::NO_TOKEN, p.default_value(), &p);
+                if (parse_errc error = p.default_handler(); error != parse_errc::ok) {
+                    result.fail(error, parse_result::NO_TOKEN, p.default_value(), &p);
+                    return;
+                }
+                pending &= pending - 1;
+            }
+        }
+
+        result.at(parse_result::NO_TOKEN, "", nullptr);
+        size_t rejected = 0;
+        parse_errc error = free_args_processor_.parse(free_args, rejected);
+        if (error == parse_errc::too_many_free_arguments) {
+            result.fail(error);
+            result.count_ = free_args.size();
+            result.max_count_ = free_args_processor_.max_count();
+        } else if (error == parse_errc::invalid_argument) {
+            result.fail(error, tokens.index_of(free_args[rejected]), free_args[rejected]);
+        }
+    }
+
+    std::string help_message_impl() const {
+        std::stringstream out;
+
+        out << "\nUsage:\n" << detail::OFFSET << program_;
+
+        /* put required arguments first */
+        std::vector<const processor*> sorted;
+        sorted.reserve(processors_.size());
+        for (size_t i = 0; i < processors_.size(); ++i) {
+            sorted.push_back(&processors_[i]);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const processor* lhs, const processor* rhs) {
+            if (lhs->is_positional() != rhs->is_positional()) {
+                return rhs->is_positional();
+            } else {
+                return lhs->is_required();
+            }
+        });
+
+        if (help_) {
+            auto it = std::find(sorted.begin(), sorted.end(), *help_);
+            if (it != sorted.end()) {
+                sorted.erase(it);
+            }
+        }
+
+        for (auto p : sorted) {
+            out << ' ' << p->usage();
+        }
+
+        out << ' ' << free_args_processor_.usage();
+
+        /* add help at first line */
+        if (help_) {
+            sorted.insert(sorted.begin(), *help_);
+        }
+
+        out << "\n\nOptions:\n";
+
+        std::vector<std::string> opts;
+        std::transform(sorted.begin(), sorted.end(), std::back_inserter(opts), [](auto p) {
+            return p->help();
+        });
+        util::normalize_tabs(opts, detail::TAB_WIDTH);
+        for (auto& s : opts) {
+            out << s << std::endl;
+        }
+
+        return out.str();
+    }
+
+private:
+    friend class compiled_parser;
+    friend struct detail::token_walker;
+
+    static constexpr const processor* NOT_FOUND = nullptr;
+
+    /*
+     * The prescan: counts the occurrences of every processor and the free arguments,
+     * so append() targets and the free argument vectors grow once per parse.
+     * Errors are left for the parse itself to report.
+     */
+    void reserve_for(const detail::token_list& tokens) const {
+        std::vector<size_t>& counts = scratch_.counts;
+        counts.assign(processors_.size(), 0);
+        size_t free_args_count = 0;
+
+        parse_result ignored;
+        detail::token_walker::walk(
+            *this,
+            tokens,
+            positional_,
+            ignored,
+            [&counts](const processor* p, size_t, std::string_view, std::string_view, size_t) {
+                ++counts[p->index()];
+                return true;
+            },
+            [&free_args_count](std::string_view, size_t) {
+                ++free_args_count;
+                return true;
+            });
+
+        for (size_t i = 0; i < processors_.size(); ++i) {
+            if (counts[i] > 1) {
+                processors_[i].reserve(counts[i]);
+            }
+        }
+        scratch_.free_args.reserve(free_args_count);
+        free_args_processor_.reserve(free_args_count);
+    }
+
+    const processor* find_short(char name) const {
+        if (auto it = short_.find(name); it != short_.end()) {
+            return it->second;
+        }
+        return NOT_FOUND;
+    }
+
+    /* The option with the long name, or the only one the name abbreviates: --verb for --verbose */
+    const processor* find_long(std::string_view name, bool& ambiguous) const {
+        auto found = long_.find(name, abbreviations_, ambiguous);
+        return found ? *found : NOT_FOUND;
+    }
+
+    static bool has_argument(const processor* p) {
+        return p->has_argument();
+    }
+
+    static std::string_view long_name(const processor* p) {
+        return p->long_name();
+    }
+
+    static void fail(
+        parse_result& result,
+        parse_errc error,
+        size_t token_index,
+        std::string_view token,
+        const processor* p) {
+        result.fail(error, token_index, token, p);
+    }
+
+    void describe_names(parse_result& result) const {
+        long_.describe(result);
+    }
+
+    /* whether word is an option whose value is the next word */
+    bool takes_argument(std::string_view word) const {
+        detail::argument_parser arg_parser(word, 0, 0);
+        std::string_view name = arg_parser.name();
+        if (arg_parser.type() == detail::argument_parser::arg_type::long_name) {
+            bool ambiguous = false;
+            const processor* p = find_long(name, ambiguous);
+            return p && !arg_parser.has_value() && p->has_argument();
+        }
+        if (arg_parser.type() != detail::argument_parser::arg_type::short_name) {
+            return false;
+        }
+        /* -vo takes the next word unless o got an attached value: -vofile */
+        for (size_t k = 0; k < name.size(); ++k) {
+            const processor* p = find_short(name[k]);
+            if (!p || p->has_argument()) {
+                return p && k + 1 == name.size();
+            }
+        }
+        return false;
+    }
+
+    /* Replaces tokens with a copy where response files are expanded, if there are any */
+    bool expand_response_files(detail::token_list& tokens, parse_result& result) const {
+        scratch_.files.clear();
+        size_t first = 1;
+        while (first < tokens.size() && !is_response_file(tokens[first])) {
+            ++first;
+        }
+        if (first == tokens.size()) {
+            return true;
+        }
+
+        std::vector<std::string_view>& expanded = scratch_.tokens;
+        expanded.clear();
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (i < first || !is_response_file(tokens[i])) {
+                expanded.push_back(tokens[i]);
+            } else if (!expand_response_file(tokens[i], 0)) {
+                result.fail(parse_errc::response_file_error, i, tokens[i].substr(1));
+                result.files_ = scratch_.files;
+                return false;
+            }
+        }
+
+        result.files_ = scratch_.files;
+        tokens = detail::token_list(expanded);
+        return true;
+    }
+
+    static bool is_response_file(std::string_view token) {
+        return token.size() > 1 && token[0] == '@';
+    }
+
+    bool expand_response_file(std::string_view token, size_t depth) const {
+        if (depth == MAX_RESPONSE_FILE_DEPTH) {
+            return false;
+        }
+        auto file = detail::mapped_file::open(util::str(token.substr(1)));
+        if (!file) {
+            return false;
+        }
+        scratch_.files.push_back(file);
+
+        std::vector<std::string_view> file_tokens;
+        if (!detail::split_in_place(file->data(), file->data() + file->size(), file_tokens)) {
+            return false;
+        }
+        for (std::string_view file_token : file_tokens) {
+            if (is_response_file(file_token)) {
+                if (!expand_response_file(file_token, depth + 1)) {
+                    return false;
+                }
+            } else {
+                scratch_.tokens.push_back(file_token);
+            }
+        }
+        return true;
+    }
+
+    template<typename... Args>
+    processor& register_processor(Args&&... args) {
+        processor& result =
+            processors_.emplace_back(&context_->strings, std::forward<Args>(args)...);
+        context_->defaults.resize(processors_.size());
+        result.attach(processors_.size() - 1, &context_->defaults);
+        snapshot_taken_ = false;
+        return result;
+    }
+
+    template<typename... Args>
+    processor& create_processor(Args&&... args) {
+        processor& result = register_processor(std::forward<Args>(args)...);
+
+        auto throw_name_is_used = [](const auto& key) {
+            throw std::logic_error(
+                util::join("Cannot add option ", key, ": the name is already used"));
+        };
+
+        if (!result.long_name().empty() && !long_.insert(result.long_name(), &result)) {
+            throw_name_is_used(result.long_name());
+        }
+        if (result.short_name() != processor::EMPTY_SHORT_NAME &&
+            !short_.emplace(result.short_name(), &result).second) {
+            throw_name_is_used(result.short_name());
+        }
+
+        return result;
+    }
+
+private:
+    std::string program_;
+    std::string title_;
+
+    /* State shared with the processors; allocated separately,
+     * so the pointers held by processors survive parser moves */
+    struct context {
+        /* indices of processors that are required or have default values */
+        detail::bitset defaults;
+        /* names, descriptions and default values of all processors */
+        detail::string_arena strings;
+    };
+
+    std::unique_ptr<context> context_{std::make_unique<context>()};
+    detail::stable_storage<processor> processors_;
+
+    /* guards against response files that include each other */
+    static constexpr size_t MAX_RESPONSE_FILE_DEPTH = 16;
+
+    /* Reused by every parse, so a parser cannot parse on several threads at once */
+    struct scratch {
+        detail::bitset seen;
+        std::vector<std::string_view> free_args;
+        /* argv with response files expanded */
+        std::vector<std::string_view> tokens;
+        /* response files the tokens point into */
+        std::vector<std::shared_ptr<const detail::mapped_file>> files;
+        /* occurrences of each processor, see prescan() */
+        std::vector<size_t> counts;
+    };
+
+    mutable scratch scratch_;
+    /* store() targets were snapshotted by a parse, see processor::restore_on_reset() */
+    mutable bool snapshot_taken_{false};
+    bool response_files_{false};
+    bool abbreviations_{false};
+    bool prescan_{false};
+    std::vector<processor*> positional_;
+    detail::long_name_table<processor*> long_;
+    std::unordered_map<char, processor*> short_;
+    std::optional<processor*> help_;
+
+    free_args_processor free_args_processor_;
+};
+
+/*
+ * Immutable snapshot of a parser, made by parser::compile().
+ * It keeps only the dispatch tables, the option properties and the rendered help,
+ * so it does not depend on the parser and may be shared by many threads at once.
+ * Handlers and store() targets of the parser are never called: the values go to
+ * a per-call compiled_parser::arguments instead. Arguments of options whose value type
+ * is known (store(), append(), handle<T>()) are validated while parsing.
+ */
+class compiled_parser {
+public:
+    /* Index of an option, looked up by name once and then used for O(1) access to arguments */
+    class handle {
+    public:
+        size_t index() const {
+            return index_;
+        }
+
+    private:
+        friend class compiled_parser;
+
+        handle(size_t index, const void* owner)
+            : index_(index)
+            , owner_(owner) {
+        }
+
+        size_t index_;
+        /* identifies the compiled_parser, see index_of(handle) */
+        const void* owner_;
+    };
+
+    /* Values of one parse; may be reused by later parses on the same thread */
+    class arguments {
+    public:
+        arguments() = default;
+
+        /* number of times the option was given on the command line */
+        size_t count(std::string_view name) const {
+            const size_t index = parser_->index_of(name);
+            return std::count_if(values_.begin(), values_.end(), [index](const auto& value) {
+                return value.first == index;
+            });
+        }
+
+        bool has(std::string_view name) const {
+            return has(parser_->option_handle(name));
+        }
+
+        bool has(handle option) const {
+            return seen_.test(parser_->index_of(option));
+        }
+
+        /* the last value given on the command line, the default value or nullopt */
+        std::optional<std::string_view> value(std::string_view name) const {
+            return value(parser_->option_handle(name));
+        }
+
+        std::optional<std::string_view> value(handle option) const {
+            const size_t index = parser_->index_of(option);
+            if (seen_.test(index)) {
+                return last_[index];
+            }
+            if (parser_->options_[index].has_default_value) {
+                return parser_->options_[index].default_value;
+            }
+            return std::nullopt;
+        }
+
+        template<typename T>
+        std::optional<T> get(std::string_view name) const {
+            return convert<T>(parser_->option_handle(name));
+        }
+
+        /*
+         * value() converted on the first call and kept until the next parse into these
+         * arguments, so the reference stays valid until then unless the same option is
+         * requested as another type. Throws util::from_string_error for a value that
+         * does not convert, which only happens with parser::compile(false).
+         * Not safe to call on several threads at once.
+         */
+        template<typename T>
+        const std::optional<T>& get(handle option) const {
+            const size_t index = parser_->index_of(option);
+            std::any& slot = converted_[index];
+            if (converted_bits_.test(index)) {
+                if (auto* cached = std::any_cast<std::optional<T>>(&slot)) {
+                    return *cached;
+                }
+            }
+            auto& stored = slot.emplace<std::optional<T>>(convert<T>(option));
+            converted_bits_.set(index);
+            return stored;
+        }
+
+        /* all values of a repeatable option in command line order */
+        template<typename T>
+        std::vector<T> get_all(std::string_view name) const {
+            const size_t index = parser_->index_of(name);
+            std::vector<T> result;
+            for (const auto& [option, value] : values_) {
+                if (option == index) {
+                    result.push_back(util::from_string<T>(value));
+                }
+            }
+            return result;
+        }
+
+        /* views into the parsed argv */
+        const std::vector<std::string_view>& free_args() const {
+            return free_args_;
+        }
+
+        /* compiled_parser does not exit on the help option, the caller decides what to do */
+        bool help_requested() const {
+            return help_requested_;
+        }
+
+    private:
+        friend class compiled_parser;
+
+        /* options without an argument, such as flags, convert to bool as whether they are given */
+        template<typename T>
+        std::optional<T> convert(handle option) const {
+            if constexpr (std::is_same_v<T, bool>) {
+                if (!parser_->options_[parser_->index_of(option)].has_argument) {
+                    return has(option);
+                }
+            }
+            if (auto found = value(option)) {
+                return util::from_string<T>(*found);
+            }
+            return std::nullopt;
+        }
+
+        void clear(const compiled_parser& parser) {
+            parser_ = &parser;
+            values_.clear();
+            free_args_.clear();
+            seen_.assign(parser.options_.size());
+            /* entries of options that are not seen are never read, so they are not cleared */
+            last_.resize(parser.options_.size());
+            converted_.resize(parser.options_.size());
+            converted_bits_.assign(parser.options_.size());
+            help_requested_ = false;
+        }
+
+    private:
+        const compiled_parser* parser_{nullptr};
+        /* option index and value, in command line order */
+        std::vector<std::pair<size_t, std::string_view>> values_;
+        std::vector<std::string_view> free_args_;
+        detail::bitset seen_;
+        /* the last value of each seen option */
+        std::vector<std::string_view> last_;
+        /* results of get(handle) since the last parse, valid where converted_bits_ is set */
+        mutable std::vector<std::any> converted_;
+        mutable detail::bitset converted_bits_;
+        bool help_requested_{false};
+    };
+
+    compiled_parser(compiled_parser&&) = default;
+    compiled_parser& operator=(compiled_parser&&) = default;
+
+    compiled_parser(const compiled_parser&) = delete;
+    compiled_parser& operator=(const compiled_parser&) = delete;
+
+    /* Clears args and fills them from argv; never throws on invalid input */
+    parse_result try_parse(int, const char* argv[], arguments& args) const {
+        return parse_tokens(detail::token_list(argv), args);
+    }
+
+    /* Same for a command line split into views, the first one being the program name */
+    parse_result try_parse(const std::vector<std::string_view>& argv, arguments& args) const {
+        return parse_tokens(detail::token_list(argv), args);
+    }
+
+    /*
+     * Parses every input on a pool of threads, where an input is anything try_parse accepts:
+     * a null-terminated argv, a vector of string_views or a command_line.
+     * For inputs that parse, convert(const arguments&, Output&) fills the input's slot of outputs.
+     * Returns the outcome of every input; any exception of convert is reported as handler_error.
+     * threads == 0 means one thread per core; the calling thread is one of them.
+     * The threads and the per-thread arguments are kept for later calls.
+     */
+    template<typename Input, typename Output, typename Convert>
+    std::vector<parse_result> parse_many(
+        const std::vector<Input>& inputs,
+        std::vector<Output>& outputs,
+        Convert&& convert,
+        size_t threads = 0) const {
+        std::vector<parse_result> results(inputs.size());
+        outputs.resize(inputs.size());
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        std::vector<arguments> sinks = take_sinks(threads);
+        detail::parallel_for(inputs.size(), threads, [&](size_t worker, size_t i) {
+            parse_result& result = results[i];
+            result = parse_input(inputs[i], sinks[worker]);
+            if (!result) {
+                return;
+            }
+            try {
+                convert(static_cast<const arguments&>(sinks[worker]), outputs[i]);
+            } catch (const std::exception& error) {
+                result.error_ = parse_errc::handler_error;
+                result.handler_message_ = error.what();
+            } catch (...) {
+                /* anything escaping the worker thread would terminate the process */
+                result.error_ = parse_errc::handler_error;
+                result.handler_message_ = "Handler threw an unknown exception.";
+            }
+        });
+        std::lock_guard<std::mutex> lock(spare_sinks_->mutex);
+        spare_sinks_->sinks.push_back(std::move(sinks));
+        return results;
+    }
+
+    /* Throws the exceptions parser::parse would have thrown with parsing_error_policy::rethrow */
+    arguments parse(int argc, const char* argv[]) const {
+        arguments args;
+        if (parse_result result = try_parse(argc, argv, args); !result) {
+            result.raise();
+        }
+        return args;
+    }
+
+    /* Throws std::logic_error for an unknown name */
+    handle option_handle(std::string_view name) const {
+        /* the arena stays in place when the compiled_parser is moved */
+        return handle(index_of(name), strings_.get());
+    }
+
+    std::string help_message(std::string_view error_message = "") const {
+        if (error_message.empty()) {
+            return help_with_title_;
+        }
+        return util::join(error_message, '\n', help_);
+    }
+
+private:
+    friend class parser;
+    friend struct detail::token_walker;
+
+    static constexpr size_t NOT_FOUND = std::numeric_limits<size_t>::max();
+
+    struct option {
+        /* long name or short name, used for lookups and messages */
+        std::string_view name;
+        std::string_view default_value;
+        bool (*check)(std::string_view){nullptr};
+        bool required{false};
+        bool repeatable{false};
+        bool has_argument{true};
+        bool has_default_value{false};
+    };
+
+    compiled_parser(const parser& source, bool validate)
+        : strings_(std::make_unique<detail::string_arena>())
+        , help_(source.help_message_impl())
+        , help_with_title_(source.help_message()) {
+        short_.fill(NOT_FOUND);
+        options_.reserve(source.processors_.size());
+
+        for (size_t i = 0; i < source.processors_.size(); ++i) {
+            const processor& p = source.processors_[i];
+            option& opt = options_.emplace_back();
+            opt.name = strings_->intern(p.name());
+            opt.default_value = strings_->intern(p.default_value());
+            opt.check = validate ? p.check_ : nullptr;
+            opt.required = p.required_;
+            opt.repeatable = p.repeatable_;
+            opt.has_argument = p.has_argument_;
+            /* the default of an option without an argument is not a value: "disable" of flag() */
+            opt.has_default_value = p.has_default_value_ && p.has_argument_;
+
+            if (p.is_positional()) {
+                positional_names_.insert(opt.name, i);
+            } else if (!p.long_name().empty()) {
+                long_.insert(opt.name, i);
+            }
+            if (p.short_name() != processor::EMPTY_SHORT_NAME) {
+                short_[static_cast<unsigned char>(p.short_name())] = i;
+            }
+        }
+
+        abbreviations_ = source.abbreviations_;
+        long_.sort();
+
+        for (const processor* p : source.positional_) {
+            positional_.push_back(p->index());
+        }
+        if (source.help_) {
+            help_index_ = (*source.help_)->index();
+        }
+        max_free_args_ = source.free_args_processor_.max_count_;
+        free_args_check_ = validate ? source.free_args_processor_.check_ : nullptr;
+    }
+
+    /* Arguments for the workers of parse_many, left by an earlier call if there is one */
+    std::vector<arguments> take_sinks(size_t count) const {
+        std::vector<arguments> sinks;
+        {
+            std::lock_guard<std::mutex> lock(spare_sinks_->mutex);
+            if (!spare_sinks_->sinks.empty()) {
+                sinks = std::move(spare_sinks_->sinks.back());
+                spare_sinks_->sinks.pop_back();
+            }
+        }
+        if (sinks.size() < count) {
+            sinks.resize(count);
+        }
+        return sinks;
+    }
+
+    parse_result parse_input(const char** argv, arguments& args) const {
+        return parse_tokens(detail::token_list(argv), args);
+    }
+
+    parse_result parse_input(const std::vector<std::string_view>& argv, arguments& args) const {
+        return parse_tokens(detail::token_list(argv), args);
+    }
+
+    parse_result parse_input(const command_line& line, arguments& args) const {
+        return parse_tokens(detail::token_list(line.args()), args);
+    }
+
+    parse_result parse_tokens(const detail::token_list& tokens, arguments& args) const {
+        parse_result result;
+        args.clear(*this);
+
+        /* records the option found in token option_index */
+        auto apply = [&](size_t index, size_t option_index, std::string_view name,
+                         std::string_view arg, size_t i) {
+            const option& opt = options_[index];
+            if (opt.has_argument && arg.empty()) {
+                fail(result, parse_errc::argument_required, i, arg, index);
+                return false;
+            }
+            if (opt.check && !opt.check(arg)) {
+                fail(result, parse_errc::invalid_argument, i, arg, index);
+                return false;
+            }
+            if (args.seen_.test(index) && !opt.repeatable) {
+                fail(result, parse_errc::not_repeatable, option_index, name, index);
+                return false;
+            }
+            args.seen_.set(index);
+            args.values_.emplace_back(index, arg);
+            args.last_[index] = arg;
+            args.help_requested_ |= index == help_index_;
+            return true;
+        };
+        auto add_free_arg = [&args](std::string_view arg, size_t) {
+            args.free_args_.push_back(arg);
+            return true;
+        };
+        if (!detail::token_walker::walk(*this, tokens, positional_, result, apply, add_free_arg)) {
+            return result;
+        }
+
+        for (size_t index = 0; index < options_.size(); ++index) {
+            const option& opt = options_[index];
+            if (args.seen_.test(index)) {
+                continue;
+            }
+            if (opt.required) {
+                fail(result, parse_errc::required_missing, parse_result::NO_TOKEN, "", index);
+                return result;
+            }
+            if (opt.has_default_value && opt.check && !opt.check(opt.default_value)) {
+                fail(
+                    result,
+                    parse_errc::invalid_argument,
+                    parse_result::NO_TOKEN,
+                    opt.default_value,
+                    index);
+                return result;
+            }
+        }
+
+        if (args.free_args_.size() > max_free_args_) {
+            result.fail(parse_errc::too_many_free_arguments);
+            result.count_ = args.free_args_.size();
+            result.max_count_ = max_free_args_;
+            return result;
+        }
+        if (free_args_check_) {
+            for (std::string_view arg : args.free_args_) {
+                if (!free_args_check_(arg)) {
+                    result.fail(parse_errc::invalid_argument, tokens.index_of(arg), arg);
+                    return result;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    /* A name may be long, positional and short at once; they are looked up in this order */
+    size_t index_of(std::string_view name) const {
+        if (auto found = long_.find(name)) {
+            return *found;
+        }
+        if (auto found = positional_names_.find(name)) {
+            return *found;
+        }
+        if (name.size() == 1 && find_short(name[0]) != NOT_FOUND) {
+            return find_short(name[0]);
+        }
+        throw std::logic_error(util::join("Unknown option ", name));
+    }
 
-            std::optional<processor*> p;
-            // Cannot use decltype(p) due to MSVC bug
-            auto try_to_find = [](const auto& map, const auto& name) -> std::optional<processor*> {
-                if (auto it = map.find(name); it != map.end()) {
-                    return it->second;
-                }
-                return std::nullopt;
+    /* Throws std::logic_error for a handle of another compiled_parser */
+    size_t index_of(handle option) const {
+        if (option.owner_ != strings_.get()) {
+            throw std::logic_error("Option handle belongs to another compiled_parser");
+        }
+        return option.index_;
+    }
+
+    size_t find_short(char name) const {
+        return short_[static_cast<unsigned char>(name)];
+    }
+
+    /* same rules as parser::find_long */
+    size_t find_long(std::string_view name, bool& ambiguous) const {
+        auto found = long_.find(name, abbreviations_, ambiguous);
+        return found ? *found : NOT_FOUND;
+    }
+
+    bool has_argument(size_t index) const {
+        return options_[index].has_argument;
+    }
+
+    std::string_view long_name(size_t index) const {
+        return options_[index].name;
+    }
+
+    void describe_names(parse_result& result) const {
+        long_.describe(result);
+    }
+
+    void fail(
+        parse_result& result,
+        parse_errc error,
+        size_t token_index,
+        std::string_view token,
+        size_t index) const {
+        result.fail(error, token_index, token);
+        result.option_name_ = options_[index].name;
+    }
+
+private:
+    /* owns the names, so they survive moves of the compiled parser */
+    std::unique_ptr<detail::string_arena> strings_;
+    std::vector<option> options_;
+    /* sorted once by the constructor, so lookups do not modify it */
+    detail::long_name_table<size_t> long_;
+    detail::name_table<size_t> positional_names_;
+    bool abbreviations_{false};
+    std::array<size_t, 256> short_;
+    std::vector<size_t> positional_;
+    size_t help_index_{NOT_FOUND};
+    size_t max_free_args_{0};
+    bool (*free_args_check_)(std::string_view){nullptr};
+
+    /* arguments of finished parse_many calls, so later calls keep their buffers */
+    struct spare_sinks {
+        std::mutex mutex;
+        std::vector<std::vector<arguments>> sinks;
+    };
+    std::unique_ptr<spare_sinks> spare_sinks_{std::make_unique<spare_sinks>()};
+
+    std::string help_;
+    std::string help_with_title_;
+};
+
+inline compiled_parser parser::compile(bool validate) const {
+    return compiled_parser(*this, validate);
+}
+
+enum class shell {
+    bash,
+    zsh,
+    fish,
+};
+
+/*
+ * Script that registers completion of program in the given shell, to be sourced
+ * from the shell's startup files. The script runs the program with the hidden
+ * --__complete option, which parser_base::parse() answers by calling complete()
+ * once completion() is enabled.
+ */
+inline std::string completion_script(shell sh, std::string_view program) {
+    /* shell function name */
+    std::string function = "_cpparg_";
+    for (char c : program.substr(program.find_last_of('/') + 1)) {
+        function += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    }
+    const std::string_view name = program.substr(program.find_last_of('/') + 1);
+
+    switch (sh) {
+    case shell::bash:
+        return util::join(
+            function, "() {\n",
+            "    local IFS=$'\\n'\n",
+            "    COMPREPLY=($(\"${COMP_WORDS[0]}\" ", detail::COMPLETE_OPTION,
+            " \"${COMP_WORDS[@]:1:COMP_CWORD}\" 2>/dev/null))\n",
+            "}\n",
+            "complete -o default -F ", function, ' ', name, '\n');
+    case shell::zsh:
+        return util::join(
+            "#compdef ", name, '\n',
+            function, "() {\n",
+            "    local -a candidates\n",
+            "    candidates=(\"${(@f)$(\"${words[1]}\" ", detail::COMPLETE_OPTION,
+            " \"${(@)words[2,CURRENT]}\" 2>/dev/null)}\")\n",
+            "    if [[ -n \"${candidates[1]}\" ]]; then\n",
+            "        compadd -- \"${candidates[@]}\"\n",
+            "    else\n",
+            "        _files\n",
+            "    fi\n",
+            "}\n",
+            "compdef ", function, ' ', name, '\n');
+    case shell::fish:
+        return util::join(
+            "function ", function, '\n',
+            "    set -l tokens (commandline -opc)\n",
+            "    set -l current (commandline -ct)\n",
+            "    $tokens[1] ", detail::COMPLETE_OPTION,
+            " $tokens[2..-1] \"$current\" 2>/dev/null\n",
+            "end\n",
+            "complete -c ", name, " -a '(", function, ")'\n");
+    }
+    return "";
+}
+
+class command_handler {
+public:
+    command_handler(std::string_view name, bool is_default = true, std::string_view parent = "")
+        : name_(util::str(name))
+        , path_(parent.empty() ? util::str(name) : util::join(parent, ' ', name))
+        , default_(is_default) {
+    }
+
+    template<typename F>
+    command_handler& handle(F&& f) {
+        using result_t = std::invoke_result_t<F, int, const char*[]>;
+        using is_void_t = std::is_same<std::decay_t<result_t>, void>;
+
+        static_assert(
+            std::is_convertible_v<result_t, int> || is_void_t::value,
+            "Command handler should return either int or void");
+
+        if constexpr (is_void_t::value) {
+            handler_ = [func{std::forward<F>(f)}](int argc, const char* argv[]) -> int {
+                func(argc, argv);
+                return 0;
             };
+        } else {
+            handler_ = std::forward<F>(f);
+        }
+        return *this;
+    }
 
-            switch (arg_parser.type()) {
-            case detail::argument_parser::arg_type::short_name:
-                p = try_to_find(short_, arg_parser.name()[0]);
-                break;
-            case detail::argument_parser::arg_type::long_name:
-                p = try_to_find(long_, util::str(arg_parser.name()));
-                break;
-            case detail::argument_parser::arg_type::positional:
-                p = positional_[next_positional++];
+    command_handler& description(std::string_view descr) {
+        description_ = util::str(descr);
+        return *this;
+    }
+
+    /* Nested subcommand, e.g. "shard" of "tool db shard" */
+    command_handler& command(std::string_view name) {
+        if (name.empty()) {
+            throw std::logic_error(util::join("Command name cannot be empty"));
+        }
+        return command_impl(name, false);
+    }
+
+    /* Same as command(name).subparser(factory) */
+    template<typename Factory>
+    command_handler& command(std::string_view name, Factory&& factory) {
+        return command(name).subparser(std::forward<Factory>(factory));
+    }
+
+    /* Subcommand used when no subcommand name is given */
+    command_handler& default_command(std::string_view name) {
+        if (default_command_) {
+            throw std::logic_error("Cannot add two default commands");
+        }
+        command_handler& result = command_impl(name, true);
+        default_command_ = &result;
+        return result;
+    }
+
+    /*
+     * Options of the command: factory(cpparg::parser&) declares them the first time
+     * the command is selected, and the parser is kept for later calls. The command's argv
+     * is parsed with it before the handler, if any, is called; parse errors are reported
+     * by the command_parser. Help of the command_parser does not build subparsers.
+     */
+    template<typename Factory>
+    command_handler& subparser(Factory&& factory) {
+        static_assert(
+            std::is_invocable_v<Factory, parser&>, "Subparser factory should take cpparg::parser&");
+        lazy_ = std::make_unique<lazy_parser>();
+        lazy_->factory = std::forward<Factory>(factory);
+        return *this;
+    }
+
+    int operator()(int argc, const char* argv[]) const {
+        return handler_(argc, argv);
+    }
+
+private:
+    friend class command_parser;
+
+    /* help lines of the subcommands, each followed by the lines of its own subcommands */
+    void help(std::vector<std::string>& lines) const {
+        auto add = [&lines](const command_handler& cmd) {
+            lines.push_back(cmd.help_line());
+            cmd.help(lines);
+        };
+        if (default_command_) {
+            add(**default_command_);
+        }
+        for (auto& ptr : commands_) {
+            if (!ptr->is_default()) {
+                add(*ptr);
+            }
+        }
+    }
+
+    std::string help_line() const {
+        std::string suffix = is_default() ? util::str(" [default]") : util::str("");
+        return util::join(detail::OFFSET, path_, '\t', description_, suffix);
+    }
+
+    bool is_default() const {
+        return default_;
+    }
+
+    bool has_commands() const {
+        return !commands_.empty();
+    }
+
+    bool is_runnable() const {
+        return handler_ || lazy_;
+    }
+
+    static std::string_view suggest_command(const void* self, std::string_view token) {
+        const command_handler& node = *static_cast<const command_handler*>(self);
+        std::vector<std::string_view> names;
+        names.reserve(node.commands_.size());
+        for (auto& ptr : node.commands_) {
+            names.push_back(ptr->name_);
+        }
+        return detail::edit_distance(token).closest(names);
+    }
+
+    const detail::prefix_index& completions() const {
+        return completions_.update(commands_.size(), [this](std::vector<std::string_view>& names) {
+            for (auto& ptr : commands_) {
+                names.push_back(ptr->name_);
+            }
+        });
+    }
+
+    /*
+     * Builds the subparser, named by program and the command path, on the first call.
+     * The subparser keeps the state of its last parse, so a command_parser
+     * cannot parse on several threads at once.
+     */
+    const parser& built_subparser(std::string_view program) const {
+        std::call_once(lazy_->once, [this, program] {
+            auto result = std::make_unique<parser>(util::join(program, ' ', path_));
+            lazy_->factory(*result);
+            lazy_->instance = std::move(result);
+        });
+        return *lazy_->instance;
+    }
+
+    command_handler& command_impl(std::string_view name, bool is_default) {
+        commands_.emplace_back(std::make_unique<command_handler>(name, is_default, path_));
+        command_handler& result = *commands_.back();
+
+        if (!command_by_name_.insert(result.name_, &result)) {
+            throw std::logic_error(util::join("Multiple commands with same name '", name, "'"));
+        }
+
+        if (is_default) {
+            command_by_name_.insert("", &result);
+        }
+
+        return result;
+    }
+
+private:
+    using command_func = std::function<int(int, const char*[])>;
+
+    command_func handler_;
+    std::string description_;
+    std::string name_;
+    /* names from the top-level command down to this one, separated by spaces */
+    std::string path_;
+    bool default_;
+
+    /* the command tree: every level is resolved by one lookup without copying the name */
+    std::vector<std::unique_ptr<command_handler>> commands_;
+    detail::name_table<command_handler*> command_by_name_;
+    std::optional<command_handler*> default_command_;
+
+    struct lazy_parser {
+        std::function<void(parser&)> factory;
+        std::once_flag once;
+        std::unique_ptr<parser> instance;
+    };
+
+    std::unique_ptr<lazy_parser> lazy_;
+
+    /* subcommand names for command_parser::complete() */
+    mutable detail::prefix_index completions_;
+};
+
+class command_parser : public detail::parser_base<command_parser> {
+public:
+    command_parser(std::string_view name)
+        : name_(util::str(name)) {
+    }
+
+    command_handler& command(std::string_view name) {
+        return root_.command(name);
+    }
+
+    template<typename Factory>
+    command_handler& command(std::string_view name, Factory&& factory) {
+        return root_.command(name, std::forward<Factory>(factory));
+    }
+
+    command_handler& default_command(std::string_view name) {
+        return root_.default_command(name);
+    }
+
+    int parse_impl(int argc, const char* argv[]) const {
+        parse_result result;
+        parse_core(argc, argv, result);
+        if (!result) {
+            result.raise();
+        }
+        return result.value();
+    }
+
+    /*
+     * Reports invalid input through result instead of throwing.
+     * The handler of the command found by select() gets argv starting from the command name.
+     */
+    void parse_core(int argc, const char* argv[], parse_result& result) const {
+        size_t start = 0;
+        size_t next = 1;
+        const command_handler* node = select(argc, argv, start, next);
+
+        if (node->has_commands() && !(node != &root_ && node->is_runnable())) {
+            const std::string_view cmd = next < static_cast<size_t>(argc) ? argv[next] : "";
+            if (cmd.empty()) {
+                result.fail(parse_errc::command_required, next);
+            } else {
+                result.fail(parse_errc::unknown_command, next, cmd);
+                result.suggest_ = &command_handler::suggest_command;
+                result.names_source_ = node;
+            }
+            /* the deepest command that matched */
+            result.command_path_ = node->path_;
+            return;
+        }
+
+        if (node == &root_) {
+            result.fail(parse_errc::command_required, next);
+            return;
+        }
+
+        const int command_argc = argc - static_cast<int>(start);
+        const char** command_argv = argv + start;
+
+        if (node->lazy_) {
+            parse_result options =
+                node->built_subparser(name_).try_reparse(command_argc, command_argv);
+            if (!options || !node->handler_) {
+                result = std::move(options);
+                if (result.token_index_ != parse_result::NO_TOKEN) {
+                    result.token_index_ += start;
+                }
+                return;
+            }
+        }
+
+        const std::string_view token = start < static_cast<size_t>(argc) ? argv[start] : "";
+        result.at(start, token, nullptr);
+        result.value_ = (*node)(command_argc, command_argv);
+    }
+
+    /*
+     * Writes the completions of the last of words, one per line: subcommands of the command
+     * named by the previous words, or options of its subparser. Handlers are not called;
+     * the subparser of the selected command is built if it was not yet.
+     */
+    void complete(const std::vector<std::string_view>& words, std::ostream& out) const {
+        const command_handler* node = &root_;
+        size_t i = 0;
+        for (; i + 1 < words.size() && !words[i].empty(); ++i) {
+            command_handler* const* child = node->command_by_name_.find(words[i]);
+            if (!child) {
                 break;
-            case detail::argument_parser::arg_type::free_arg_delimiter:
-                was_free_arg_delimiter = true;
-                continue;
-            default:
+            }
+            node = *child;
+        }
+
+        const std::string_view current = words.empty() ? "" : words.back();
+        if (node->lazy_ && (i + 1 < words.size() || util::starts_with(current, "-"))) {
+            std::vector<std::string_view> rest(words.begin() + i, words.end());
+            node->built_subparser(name_).complete(rest, out);
+        } else if (i + 1 >= words.size()) {
+            node->completions().for_each(current, [&out](auto name) {
+                out << name << '\n';
+            });
+        }
+    }
+
+    /* Help of the subparser that rejected argv, or of the command_parser */
+    std::string error_help_message(int argc, const char* argv[], std::string_view error_message)
+        const {
+        size_t start = 0;
+        size_t next = 1;
+        const command_handler* node = select(argc, argv, start, next);
+        /* a command with a subparser is always runnable, so parse_core selected it */
+        if (node != &root_ && node->lazy_) {
+            return node->built_subparser(name_).help_message(error_message);
+        }
+        return help_message(error_message);
+    }
+
+    std::string help_message_impl() const {
+        std::stringstream out;
+
+        out << "\nUsage:\n" << detail::OFFSET << name_ << " <command> <command args>";
+
+        out << "\n\nCommands:\n";
+
+        std::vector<std::string> cmds;
+        root_.help(cmds);
+
+        util::normalize_tabs(cmds, detail::TAB_WIDTH);
+
+        for (auto& s : cmds) {
+            out << s << std::endl;
+        }
+
+        return out.str();
+    }
+
+private:
+    /*
+     * Walks the command tree along argv until a command without subcommands,
+     * or a command with a handler whose next argument is not a subcommand.
+     * start is the index of the command name, next the index of the following argument.
+     */
+    const command_handler* select(int argc, const char* argv[], size_t& start, size_t& next)
+        const {
+        const command_handler* node = &root_;
+        while (node->has_commands()) {
+            const bool has_token = next < static_cast<size_t>(argc);
+            const std::string_view cmd = has_token ? argv[next] : "";
+            command_handler* const* child = node->command_by_name_.find(cmd);
+            if (!child) {
                 break;
             }
-
-            if (!p) {
-                throw processor_error(util::join("Unknown option ", arg_parser.name(), "."));
+            node = *child;
+            start = next;
+            next += has_token;
+        }
+        return node;
+    }
+
+private:
+    std::string name_;
+    command_handler root_{"", false};
+};
+
+namespace detail {
+
+/* Type-erased part of option_spec */
+struct static_option {
+    static constexpr char NO_SHORT_NAME = '\0';
+
+    char short_name{NO_SHORT_NAME};
+    std::string_view long_name;
+    bool has_argument{true};
+    bool required{false};
+};
+
+constexpr size_t next_power_of_two(size_t n) {
+    size_t result = 1;
+    while (result < n) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace detail
+
+/* Compile-time option description, see static_parser */
+template<typename T>
+class option_spec {
+public:
+    using value_type = T;
+
+    constexpr option_spec(char sname, std::string_view lname, bool has_argument) {
+        option_.short_name = sname;
+        option_.long_name = lname;
+        option_.has_argument = has_argument;
+    }
+
+    constexpr option_spec required() const {
+        option_spec result = *this;
+        result.option_.required = true;
+        return result;
+    }
+
+    constexpr const detail::static_option& get() const {
+        return option_;
+    }
+
+private:
+    detail::static_option option_;
+};
+
+template<typename T>
+constexpr option_spec<T> option(char sname, std::string_view lname = "") {
+    return {sname, lname, true};
+}
+
+template<typename T>
+constexpr option_spec<T> option(std::string_view lname) {
+    return {detail::static_option::NO_SHORT_NAME, lname, true};
+}
+
+/* Option without an argument; its value is true when it is present */
+constexpr option_spec<bool> flag(char sname, std::string_view lname = "") {
+    return {sname, lname, false};
+}
+
+constexpr option_spec<bool> flag(std::string_view lname) {
+    return {detail::static_option::NO_SHORT_NAME, lname, false};
+}
+
+/*
+ * Parser whose options are known at compile time:
+ *
+ *   constexpr cpparg::static_parser schema{
+ *       cpparg::option<int>('n', "number").required(),
+ *       cpparg::flag('v', "verbose"),
+ *   };
+ *   auto values = schema.parse(argc, argv);
+ *   int n = *values.get<0>();
+ *
+ * The schema must be a constexpr variable: then duplicate or malformed names fail to compile,
+ * and the long names are dispatched by a perfect hash table built by the compiler.
+ * Options cannot be repeated; positional arguments are not supported.
+ */
+template<typename... Ts>
+class static_parser {
+public:
+    static constexpr size_t OPTIONS_COUNT = sizeof...(Ts);
+
+    struct values {
+        std::tuple<std::optional<Ts>...> options;
+        /* views into the parsed argv */
+        std::vector<std::string_view> free_args;
+
+        template<size_t I>
+        const auto& get() const {
+            return std::get<I>(options);
+        }
+    };
+
+    constexpr explicit static_parser(const option_spec<Ts>&... specs)
+        : options_{specs.get()...} {
+        check_names();
+        build_short_table();
+        build_long_table();
+    }
+
+    /* Clears values and fills them from argv; values are left partially filled on failure */
+    parse_result try_parse(int, const char* argv[], values& result_values) const {
+        parse_result result;
+        result_values = values{};
+        std::array<bool, OPTIONS_COUNT> seen{};
+
+        /* stores the option found in token option_index */
+        auto apply = [&](size_t index, size_t option_index, std::string_view name,
+                         std::string_view arg, size_t i) {
+            if (seen[index]) {
+                fail(result, parse_errc::not_repeatable, option_index, name, index);
+                return false;
+            }
+            seen[index] = true;
+
+            if (!options_[index].has_argument) {
+                /* flags are stored as true */
+                arg = "1";
+            } else if (arg.empty()) {
+                fail(result, parse_errc::argument_required, i, arg, index);
+                return false;
+            }
+            if (!STORE[index](arg, result_values)) {
+                fail(result, parse_errc::invalid_argument, i, arg, index);
+                return false;
             }
+            return true;
+        };
+        auto add_free_arg = [&result_values](std::string_view arg, size_t) {
+            result_values.free_args.push_back(arg);
+            return true;
+        };
+        const std::array<size_t, 0> no_positionals{};
+        if (!detail::token_walker::walk(
+                *this, detail::token_list(argv), no_positionals, result, apply, add_free_arg)) {
+            return result;
+        }
 
-            std::string_view arg = "";
-
-            if ((*p)->has_argument()) {
-                const char* next = *(argv + 1);
-                if (arg_parser.type() == detail::argument_parser::arg_type::positional) {
-                    arg = arg_parser.name();
-                } else if (next) {
-                    if (!util::starts_with(next, "-")) {
-                        arg = next;
-                        ++argv;
-                    }
-                }
+        for (size_t index = 0; index < OPTIONS_COUNT; ++index) {
+            if (options_[index].required && !seen[index]) {
+                fail(result, parse_errc::required_missing, parse_result::NO_TOKEN, "", index);
+                return result;
             }
+        }
 
-            (*p)->parse(arg);
+        return result;
+    }
 
-            auto it = unused.find(*p);
-            if (it == unused.end() && !(*p)->is_repeatable()) {
-                throw processor_error(
-                    util::join("Option '", arg_parser.name(), "' is not repeatable"));
-            } else if (it != unused.end()) {
-                unused.erase(it);
-            }
+    values parse(int argc, const char* argv[]) const {
+        values result_values;
+        if (parse_result result = try_parse(argc, argv, result_values); !result) {
+            result.raise();
         }
+        return result_values;
+    }
 
-        for (const processor* p : unused) {
-            p->default_handler();
+    /* index of the option with the given long name or OPTIONS_COUNT */
+    constexpr size_t find_long(std::string_view name) const {
+        const uint64_t hash = detail::hash_name(name);
+        const size_t slot = slots_[place(hash, displacements_[hash & (BUCKETS_COUNT - 1)])];
+        if (slot == 0 || options_[slot - 1].long_name != name) {
+            return OPTIONS_COUNT;
         }
+        return slot - 1;
+    }
 
-        free_args_processor_.parse(free_args);
-
-        return 0;
+    /* index of the option with the given short name or OPTIONS_COUNT */
+    constexpr size_t find_short(char name) const {
+        const size_t slot = short_slots_[static_cast<unsigned char>(name)];
+        return slot == 0 ? OPTIONS_COUNT : slot - 1;
     }
 
-    std::string help_message_impl() const {
-        std::stringstream out;
+private:
+    friend struct detail::token_walker;
 
-        out << "\nUsage:\n" << detail::OFFSET << program_;
+    static constexpr size_t NOT_FOUND = OPTIONS_COUNT;
+    static constexpr size_t BUCKETS_COUNT = detail::next_power_of_two(OPTIONS_COUNT);
+    static constexpr size_t SLOTS_COUNT = detail::next_power_of_two(2 * OPTIONS_COUNT);
 
-        /* put required arguments first */
-        std::vector<const processor*> sorted;
-        std::transform(
-            processors_.begin(), processors_.end(), std::back_inserter(sorted), [](const auto& p) {
-                return p.get();
-            });
-        std::sort(sorted.begin(), sorted.end(), [](const processor* lhs, const processor* rhs) {
-            if (lhs->is_positional() != rhs->is_positional()) {
-                return rhs->is_positional();
-            } else {
-                return lhs->is_required();
-            }
-        });
+    using store_func = bool (*)(std::string_view, values&);
 
-        if (help_) {
-            auto it = std::find(sorted.begin(), sorted.end(), *help_);
-            if (it != sorted.end()) {
-                sorted.erase(it);
+    template<size_t I>
+    static bool store(std::string_view arg, values& result_values) {
+        using value_type = std::tuple_element_t<I, std::tuple<Ts...>>;
+        return util::try_from_string<value_type>(
+            arg, std::get<I>(result_values.options).emplace());
+    }
+
+    template<size_t... Is>
+    static constexpr std::array<store_func, OPTIONS_COUNT> make_store_table(
+        std::index_sequence<Is...>) {
+        return {&store<Is>...};
+    }
+
+    static constexpr std::array<store_func, OPTIONS_COUNT> STORE =
+        make_store_table(std::index_sequence_for<Ts...>{});
+
+    static std::string_view suggest_option(const void* self, std::string_view token) {
+        const static_parser& source = *static_cast<const static_parser*>(self);
+        std::vector<std::string_view> names;
+        for (const detail::static_option& option : source.options_) {
+            if (!option.long_name.empty()) {
+                names.push_back(option.long_name);
             }
         }
+        return detail::edit_distance(token).closest(names);
+    }
 
-        for (auto p : sorted) {
-            out << ' ' << p->usage();
-        }
+    /* long names are dispatched by the perfect hash, they cannot be abbreviated */
+    constexpr size_t find_long(std::string_view name, bool& ambiguous) const {
+        ambiguous = false;
+        return find_long(name);
+    }
 
-        out << ' ' << free_args_processor_.usage();
+    constexpr bool has_argument(size_t index) const {
+        return options_[index].has_argument;
+    }
 
-        /* add help at first line */
-        if (help_) {
-            sorted.insert(sorted.begin(), *help_);
-        }
+    constexpr std::string_view long_name(size_t index) const {
+        return options_[index].long_name;
+    }
 
-        out << "\n\nOptions:\n";
+    void describe_names(parse_result& result) const {
+        result.suggest_ = &static_parser::suggest_option;
+        result.names_source_ = this;
+    }
 
-        std::vector<std::string> opts;
-        std::transform(sorted.begin(), sorted.end(), std::back_inserter(opts), [](auto p) {
-            return p->help();
-        });
-        util::normalize_tabs(opts, detail::TAB_WIDTH);
-        for (auto& s : opts) {
-            out << s << std::endl;
+    void fail(
+        parse_result& result,
+        parse_errc error,
+        size_t token_index,
+        std::string_view token,
+        size_t index) const {
+        const detail::static_option& option = options_[index];
+        result.fail(error, token_index, token);
+        result.option_name_ = option.long_name.empty()
+            ? std::string_view(&option.short_name, 1)
+            : option.long_name;
+    }
+
+    /*
+     * Throwing here is not a constant expression, which makes bad names a compile error.
+     * Duplicates are found while building the tables, see build_long_table().
+     */
+    constexpr void check_names() const {
+        for (size_t i = 0; i < OPTIONS_COUNT; ++i) {
+            const detail::static_option& option = options_[i];
+            if (option.long_name.empty() &&
+                option.short_name == detail::static_option::NO_SHORT_NAME) {
+                throw std::logic_error("Option should have a name");
+            }
+            if (option.short_name == '-' ||
+                (!option.long_name.empty() && option.long_name[0] == '-')) {
+                throw std::logic_error("Option name cannot start with '-'");
+            }
         }
+    }
 
-        return out.str();
+    constexpr void build_short_table() {
+        for (size_t i = 0; i < OPTIONS_COUNT; ++i) {
+            if (options_[i].short_name != detail::static_option::NO_SHORT_NAME) {
+                size_t& slot = short_slots_[static_cast<unsigned char>(options_[i].short_name)];
+                if (slot != 0) {
+                    throw std::logic_error("Duplicate short option name");
+                }
+                slot = i + 1;
+            }
+        }
     }
 
-private:
-    template<typename... Args>
-    processor& create_processor(Args&&... args) {
-        processors_.emplace_back(std::make_unique<processor>(std::forward<Args>(args)...));
-        processor& result = *processors_.back();
+    /*
+     * Slot of a name in a bucket with the given displacement (d0 << 32 | d1), as in CHD:
+     * (f1 + d0 * f2 + d1) mod SLOTS_COUNT, where f1 and f2 are bits of the name's hash
+     * other than the bucket ones, and f2 is odd, so every d0 moves the names differently.
+     */
+    static constexpr size_t place(uint64_t hash, uint64_t displacement) {
+        const uint64_t f1 = hash >> 16;
+        const uint64_t f2 = (hash >> 40) | 1;
+        const uint64_t d0 = displacement >> 32;
+        const uint64_t d1 = displacement & 0xffffffff;
+        return static_cast<size_t>((f1 + d0 * f2 + d1) & (SLOTS_COUNT - 1));
+    }
 
-        auto try_to_insert = [](auto& map, const auto& key, const auto& value) {
-            auto [it, inserted] = map.emplace(key, value);
-            if (!inserted) {
-                throw std::logic_error(
-                    util::join("Cannot add option ", key, ": the name is already used"));
+    /*
+     * Hash and displace: long names are hashed once and split into buckets by the hash,
+     * then, from the largest bucket down, the first displacement that moves the whole bucket
+     * into free slots is searched for. The search only does arithmetic on the stored hashes
+     * and tries at most SLOTS_COUNT^2 displacements per bucket, so it is bounded; with
+     * slots for twice the options, a bucket usually takes a few tries.
+     */
+    constexpr void build_long_table() {
+        std::array<uint64_t, OPTIONS_COUNT> hashes{};
+        /* names of bucket b are members[starts[b]] .. members[starts[b + 1] - 1] */
+        std::array<size_t, BUCKETS_COUNT + 1> starts{};
+        for (size_t i = 0; i < OPTIONS_COUNT; ++i) {
+            if (!options_[i].long_name.empty()) {
+                hashes[i] = detail::hash_name(options_[i].long_name);
+                ++starts[(hashes[i] & (BUCKETS_COUNT - 1)) + 1];
             }
-        };
+        }
+        size_t largest = 0;
+        for (size_t b = 0; b < BUCKETS_COUNT; ++b) {
+            largest = std::max(largest, starts[b + 1]);
+            starts[b + 1] += starts[b];
+        }
+        std::array<size_t, OPTIONS_COUNT> members{};
+        std::array<size_t, BUCKETS_COUNT> filled{};
+        for (size_t i = 0; i < OPTIONS_COUNT; ++i) {
+            if (!options_[i].long_name.empty()) {
+                const size_t b = hashes[i] & (BUCKETS_COUNT - 1);
+                members[starts[b] + filled[b]++] = i;
+            }
+        }
 
-        if (!result.long_name().empty()) {
-            try_to_insert(long_, util::str(result.long_name()), &result);
+        /* equal names have equal hashes, so only names of one bucket are compared */
+        for (size_t b = 0; b < BUCKETS_COUNT; ++b) {
+            for (size_t k = starts[b]; k < starts[b + 1]; ++k) {
+                for (size_t j = starts[b]; j < k; ++j) {
+                    if (hashes[members[j]] == hashes[members[k]] &&
+                        options_[members[j]].long_name == options_[members[k]].long_name) {
+                        throw std::logic_error("Duplicate long option name");
+                    }
+                }
+            }
         }
-        if (result.short_name() != processor::EMPTY_SHORT_NAME) {
-            try_to_insert(short_, result.short_name(), &result);
+
+        for (size_t size = largest; size > 0; --size) {
+            for (size_t b = 0; b < BUCKETS_COUNT; ++b) {
+                if (starts[b + 1] - starts[b] == size) {
+                    displacements_[b] = displace(hashes, members, starts[b], starts[b + 1]);
+                }
+            }
         }
+    }
 
-        return result;
+    /* Places the names members[first] .. members[last - 1] and returns their displacement */
+    constexpr uint64_t displace(
+        const std::array<uint64_t, OPTIONS_COUNT>& hashes,
+        const std::array<size_t, OPTIONS_COUNT>& members,
+        size_t first,
+        size_t last) {
+        std::array<size_t, OPTIONS_COUNT> placed{};
+        for (uint64_t d0 = 0; d0 < SLOTS_COUNT; ++d0) {
+            for (uint64_t d1 = 0; d1 < SLOTS_COUNT; ++d1) {
+                const uint64_t displacement = d0 << 32 | d1;
+                bool fits = true;
+                for (size_t k = first; fits && k < last; ++k) {
+                    const size_t slot = place(hashes[members[k]], displacement);
+                    fits = slots_[slot] == 0;
+                    for (size_t j = first; fits && j < k; ++j) {
+                        fits = placed[j - first] != slot;
+                    }
+                    placed[k - first] = slot;
+                }
+                if (fits) {
+                    for (size_t k = first; k < last; ++k) {
+                        slots_[placed[k - first]] = members[k] + 1;
+                    }
+                    return displacement;
+                }
+            }
+        }
+        /* only names whose hashes share all the bits place() looks at */
+        throw std::logic_error("Cannot build a perfect hash for option names");
     }
 
 private:
-    std::string program_;
-    std::string title_;
+    std::array<detail::static_option, OPTIONS_COUNT> options_;
+    /* option index + 1, zero for empty slots */
+    std::array<size_t, 256> short_slots_{};
+    std::array<size_t, SLOTS_COUNT> slots_{};
+    std::array<uint64_t, BUCKETS_COUNT> displacements_{};
+};
 
-    std::vector<std::unique_ptr<processor>> processors_;
-    std::vector<processor*> positional_;
-    std::unordered_map<std::string, processor*> long_;
-    std::unordered_map<char, processor*> short_;
-    std::optional<processor*> help_;
+namespace detail {
 
-    free_args_processor free_args_processor_;
-};
+template<typename T>
+struct is_vector : std::false_type {};
 
-class command_handler {
-public:
-    command_handler(std::string_view name, bool is_default = true)
-        : name_(util::str(name))
-        , default_(is_default) {
-    }
+template<typename T, typename Alloc>
+struct is_vector<std::vector<T, Alloc>> : std::true_type {};
 
-    template<typename F>
-    command_handler& handle(F&& f) {
-        using result_t = std::invoke_result_t<F, int, const char*[]>;
-        using is_void_t = std::is_same<std::decay_t<result_t>, void>;
+/* type of one value of a struct_parser field */
+template<typename T>
+struct field_value {
+    using type = T;
+};
 
-        static_assert(
-            std::is_convertible_v<result_t, int> || is_void_t::value,
-            "Command handler should return either int or void");
+template<typename T, typename Alloc>
+struct field_value<std::vector<T, Alloc>> {
+    using type = T;
+};
 
-        if constexpr (is_void_t::value) {
-            handler_ = [func{std::forward<F>(f)}](int argc, const char* argv[]) -> int {
-                func(argc, argv);
-                return 0;
-            };
+template<typename T>
+struct field_value<std::optional<T>> {
+    using type = T;
+};
+
+/*
+ * Converter of a struct_parser field; field points into the destination struct.
+ * first is set for the first occurrence of the option in a parse.
+ */
+template<typename T>
+bool convert_field(std::string_view arg, void* field, bool first) {
+    T& dest = *static_cast<T*>(field);
+    if constexpr (std::is_same_v<T, bool>) {
+        dest = true;
+        return true;
+    } else {
+        /*
+         * vectors collect every occurrence, replacing the initializer of the member,
+         * optionals and plain fields take the last one
+         */
+        typename field_value<T>::type value;
+        if (!util::try_from_string(arg, value)) {
+            return false;
+        }
+        if constexpr (is_vector<T>::value) {
+            if (first) {
+                dest.clear();
+            }
+            dest.push_back(std::move(value));
         } else {
-            handler_ = std::forward<F>(f);
+            dest = std::move(value);
         }
-        return *this;
+        return true;
     }
+}
 
-    command_handler& description(std::string_view descr) {
-        description_ = util::str(descr);
-        return *this;
-    }
+} // namespace detail
 
-    int operator()(int argc, const char* argv[]) const {
-        return handler_(argc, argv);
+/* Member of a config struct bound to an option, see struct_parser */
+template<typename Struct, typename T>
+class field_spec {
+public:
+    field_spec(T Struct::*member, char sname, std::string_view lname)
+        : member_(member)
+        , short_name_(sname)
+        , long_name_(lname) {
     }
 
-private:
-    friend class command_parser;
-
-    std::string help() const {
-        std::string suffix = is_default() ? util::str(" [default]") : util::str("");
-        return util::join(detail::OFFSET, name_, '\t', description_, suffix);
+    field_spec& required() {
+        required_ = true;
+        return *this;
     }
 
-    bool is_default() const {
-        return default_;
+    field_spec& description(std::string_view descr) {
+        description_ = descr;
+        return *this;
     }
 
 private:
-    using command_func = std::function<int(int, const char*[])>;
-
-    command_func handler_;
-    std::string description_;
-    std::string name_;
-    bool default_;
+    template<typename S>
+    friend class struct_parser;
+    template<typename S, typename U>
+    friend field_spec<S, std::vector<U>> free_args(std::vector<U> S::*member);
+
+    T Struct::*member_;
+    char short_name_;
+    std::string_view long_name_;
+    std::string_view description_;
+    bool required_{false};
+    bool free_args_{false};
 };
 
-class command_parser : public detail::parser_base<command_parser> {
+template<typename Struct, typename T>
+field_spec<Struct, T> field(T Struct::*member, char sname, std::string_view lname = "") {
+    return {member, sname, lname};
+}
+
+template<typename Struct, typename T>
+field_spec<Struct, T> field(T Struct::*member, std::string_view lname) {
+    return {member, detail::static_option::NO_SHORT_NAME, lname};
+}
+
+/* The vector that receives the free arguments; without it they are an error */
+template<typename Struct, typename T>
+field_spec<Struct, std::vector<T>> free_args(std::vector<T> Struct::*member) {
+    field_spec<Struct, std::vector<T>> result{member, detail::static_option::NO_SHORT_NAME, ""};
+    result.free_args_ = true;
+    return result;
+}
+
+/*
+ * Parser that writes straight into a config struct:
+ *
+ *   struct config {
+ *       int port = 80;
+ *       std::string host;
+ *       bool verbose = false;
+ *       std::vector<int> shards;
+ *   };
+ *   cpparg::struct_parser schema{
+ *       cpparg::field(&config::port, 'p', "port").description("Port to listen on"),
+ *       cpparg::field(&config::host, "host").required(),
+ *       cpparg::field(&config::verbose, 'v', "verbose"),
+ *       cpparg::field(&config::shards, "shard"),
+ *   };
+ *   schema.add_help('h', "help");
+ *   config cfg = schema.parse(argc, argv);
+ *
+ * The fields are described once and become one table of members and per-type
+ * converters, so a parse needs no handler per option. The kind of option follows
+ * from the member type: bool members are flags, std::vector members are repeatable
+ * and collect every value, std::optional and other members take one value.
+ * Members that are not given keep their values, so member initializers are the defaults.
+ * Once configured, the parser is not modified by parsing and may be shared by many threads.
+ */
+template<typename Struct>
+class struct_parser {
 public:
-    command_parser(std::string_view name)
-        : name_(util::str(name)) {
+    template<typename... Ts>
+    explicit struct_parser(const field_spec<Struct, Ts>&... fields)
+        : strings_(std::make_unique<detail::string_arena>()) {
+        short_.fill(NOT_FOUND);
+        (add_field(fields), ...);
+        long_.sort();
     }
 
-    command_handler& command(std::string_view name) {
-        if (name.empty()) {
-            throw std::logic_error(util::join("Command name cannot be empty"));
+    struct_parser& title(std::string_view title) {
+        title_ = util::str(title);
+        return *this;
+    }
+
+    /* same as parser::abbreviations */
+    struct_parser& abbreviations(bool enabled = true) {
+        abbreviations_ = enabled;
+        return *this;
+    }
+
+    /*
+     * With the option parse() prints help_message() and exits, as parser::add_help does;
+     * try_parse() stops there and reports parse_result::help_requested() instead.
+     */
+    struct_parser& add_help(char sname, std::string_view lname = "") {
+        if (help_index_ != NOT_FOUND) {
+            throw std::logic_error("Cannot add two help options");
         }
-        return command_impl(name, false);
+        field& f = fields_.emplace_back();
+        f.has_argument = false;
+        f.description = "Print this help and exit";
+        help_index_ = fields_.size() - 1;
+        add_names(f, sname, lname);
+        long_.sort();
+        return *this;
     }
 
-    command_handler& default_command(std::string_view name) {
-        if (default_) {
-            throw std::logic_error("Cannot add two default commands");
+    /* The options with their descriptions, after error_message or the title */
+    std::string help_message(std::string_view error_message = "") const {
+        std::vector<std::string> lines;
+        if (help_index_ != NOT_FOUND) {
+            lines.push_back(field_help(fields_[help_index_]));
         }
-        command_handler& result = command_impl(name, true);
-        default_ = &result;
-        return result;
+        for (size_t index = 0; index < fields_.size(); ++index) {
+            if (index != help_index_ && index != free_args_) {
+                lines.push_back(field_help(fields_[index]));
+            }
+        }
+        util::normalize_tabs(lines, detail::TAB_WIDTH);
+
+        std::stringstream out;
+        out << (error_message.empty() ? std::string_view(title_) : error_message);
+        out << "\n\nOptions:\n";
+        for (const auto& line : lines) {
+            out << line << std::endl;
+        }
+        return out.str();
     }
 
-    int parse_impl(int argc, const char* argv[]) const {
-        std::string_view cmd = "";
-        if (argc > 1) {
-            cmd = argv[1];
+    /* Fills out from argv; out is left partially filled on failure */
+    parse_result try_parse(int, const char* argv[], Struct& out) const {
+        parse_result result;
+        detail::bitset seen;
+        seen.assign(fields_.size());
+        size_t free_args_count = 0;
+
+        /* converts the option found in token option_index into its member */
+        auto apply = [&](size_t index, size_t option_index, std::string_view name,
+                         std::string_view arg, size_t i) {
+            const field& f = fields_[index];
+            if (index == help_index_) {
+                result.help_requested_ = true;
+                return false;
+            }
+            const bool first = !seen.test(index);
+            if (!first && !f.repeatable) {
+                fail(result, parse_errc::not_repeatable, option_index, name, index);
+                return false;
+            }
+            seen.set(index);
+
+            if (f.has_argument && arg.empty()) {
+                fail(result, parse_errc::argument_required, i, arg, index);
+                return false;
+            }
+            if (!f.convert(arg, out, first)) {
+                fail(result, parse_errc::invalid_argument, i, arg, index);
+                return false;
+            }
+            return true;
+        };
+        auto add_free_arg = [&](std::string_view arg, size_t i) {
+            ++free_args_count;
+            if (free_args_ == NOT_FOUND) {
+                return true;
+            }
+            if (!fields_[free_args_].convert(arg, out, free_args_count == 1)) {
+                result.fail(parse_errc::invalid_argument, i, arg);
+                return false;
+            }
+            return true;
+        };
+        const std::array<size_t, 0> no_positionals{};
+        if (!detail::token_walker::walk(
+                *this, detail::token_list(argv), no_positionals, result, apply, add_free_arg)) {
+            return result;
         }
 
-        auto it = command_by_name_.find(util::str(cmd));
-        if (it == command_by_name_.end()) {
-            if (cmd.empty()) {
-                throw parser_error("Command name is required.");
-            } else {
-                throw parser_error(util::join("Unknown command '", cmd, "'."));
+        if (free_args_ == NOT_FOUND && free_args_count > 0) {
+            result.fail(parse_errc::too_many_free_arguments);
+            result.count_ = free_args_count;
+            result.max_count_ = 0;
+            return result;
+        }
+        for (size_t index = 0; index < fields_.size(); ++index) {
+            if (fields_[index].required && !seen.test(index)) {
+                fail(result, parse_errc::required_missing, parse_result::NO_TOKEN, "", index);
+                return result;
             }
         }
 
-        return (*it->second)(argc - 1, argv + 1);
+        return result;
     }
 
-    std::string help_message_impl() const {
-        std::stringstream out;
+    /* Throws the exceptions parser::parse would have thrown with parsing_error_policy::rethrow */
+    Struct parse(int argc, const char* argv[]) const {
+        Struct out{};
+        parse_result result = try_parse(argc, argv, out);
+        if (!result) {
+            result.raise();
+        }
+        if (result.help_requested()) {
+            std::cerr << help_message() << std::endl;
+            exit(0);
+        }
+        return out;
+    }
 
-        out << "\nUsage:\n" << detail::OFFSET << name_ << " <command> <command args>";
+private:
+    friend struct detail::token_walker;
+
+    static constexpr size_t NOT_FOUND = std::numeric_limits<size_t>::max();
+
+    struct field {
+        /* long name or short name, used for lookups and messages */
+        std::string_view name;
+        std::string_view long_name;
+        char short_name{detail::static_option::NO_SHORT_NAME};
+        std::string_view description;
+        /* converts a value into the member of the struct, see detail::convert_field */
+        detail::inline_function<bool(std::string_view, Struct&, bool)> convert;
+        bool required{false};
+        bool repeatable{false};
+        bool has_argument{true};
+    };
 
-        out << "\n\nCommands:\n";
+    template<typename T>
+    void add_field(const field_spec<Struct, T>& spec) {
+        field& f = fields_.emplace_back();
+        f.convert = [member = spec.member_](std::string_view arg, Struct& out, bool first) {
+            return detail::convert_field<T>(arg, std::addressof(out.*member), first);
+        };
+        f.required = spec.required_;
+        f.repeatable = detail::is_vector<T>::value;
+        f.has_argument = !std::is_same_v<T, bool>;
+        f.description = strings_->intern(spec.description_);
+
+        if (spec.free_args_) {
+            if (free_args_ != NOT_FOUND) {
+                throw std::logic_error("Free arguments can be bound to one member only");
+            }
+            free_args_ = fields_.size() - 1;
+            return;
+        }
+        add_names(f, spec.short_name_, spec.long_name_);
+    }
 
-        std::vector<std::string> cmds;
+    /* registers the names of the last field */
+    void add_names(field& f, char sname, std::string_view lname) {
+        const size_t index = fields_.size() - 1;
+        auto throw_name_is_used = [](const auto& key) {
+            throw std::logic_error(
+                util::join("Cannot add option ", key, ": the name is already used"));
+        };
 
-        cmds.reserve(commands_.size());
-        for (auto& ptr : commands_) {
-            if (ptr->is_default()) {
-                cmds.insert(cmds.begin(), ptr->help());
-            } else {
-                cmds.push_back(ptr->help());
+        if (lname.empty() && sname == detail::static_option::NO_SHORT_NAME) {
+            throw std::logic_error("Cannot add a field without a name");
+        }
+        if (!lname.empty()) {
+            f.long_name = strings_->intern(lname);
+            f.name = f.long_name;
+            if (!long_.insert(f.name, index)) {
+                throw_name_is_used(f.name);
             }
+        } else {
+            f.name = strings_->intern(std::string_view(&sname, 1));
         }
+        if (sname != detail::static_option::NO_SHORT_NAME) {
+            f.short_name = sname;
+            size_t& slot = short_[static_cast<unsigned char>(sname)];
+            if (slot != NOT_FOUND) {
+                throw_name_is_used(sname);
+            }
+            slot = index;
+        }
+    }
 
-        util::normalize_tabs(cmds, detail::TAB_WIDTH);
-
-        for (auto& s : cmds) {
-            out << s << std::endl;
+    static std::string field_help(const field& f) {
+        std::stringstream result;
+        result << detail::OFFSET;
+        if (f.short_name != detail::static_option::NO_SHORT_NAME) {
+            result << '-' << f.short_name;
         }
+        if (f.short_name != detail::static_option::NO_SHORT_NAME && !f.long_name.empty()) {
+            result << ", ";
+        }
+        if (!f.long_name.empty()) {
+            result << "--" << f.long_name;
+        }
+        result << '\t' << f.description;
+        if (f.required) {
+            result << " (required)";
+        }
+        if (f.repeatable) {
+            result << " (repeatable)";
+        }
+        return result.str();
+    }
 
-        return out.str();
+    size_t find_short(char name) const {
+        return short_[static_cast<unsigned char>(name)];
     }
 
-private:
-    command_handler& command_impl(std::string_view name = "", bool is_default = false) {
-        commands_.emplace_back(std::make_unique<command_handler>(name, is_default));
-        command_handler& result = *commands_.back();
+    /* same rules as parser::find_long */
+    size_t find_long(std::string_view name, bool& ambiguous) const {
+        auto found = long_.find(name, abbreviations_, ambiguous);
+        return found ? *found : NOT_FOUND;
+    }
 
-        auto [it, inserted] = command_by_name_.emplace(util::str(name), &result);
-        if (!inserted) {
-            throw std::logic_error(util::join("Multiple commands with same name '", name, "'"));
-        }
+    bool has_argument(size_t index) const {
+        return fields_[index].has_argument;
+    }
 
-        if (is_default) {
-            command_by_name_.emplace("", &result);
-        }
+    std::string_view long_name(size_t index) const {
+        return fields_[index].long_name;
+    }
 
-        return result;
+    void describe_names(parse_result& result) const {
+        long_.describe(result);
+    }
+
+    void fail(
+        parse_result& result,
+        parse_errc error,
+        size_t token_index,
+        std::string_view token,
+        size_t index) const {
+        result.fail(error, token_index, token);
+        result.option_name_ = fields_[index].name;
     }
 
 private:
-    std::string name_;
-    std::vector<std::unique_ptr<command_handler>> commands_;
-    std::unordered_map<std::string, command_handler*> command_by_name_;
-    std::optional<command_handler*> default_;
+    /* owns the names, so they survive moves of the parser */
+    std::unique_ptr<detail::string_arena> strings_;
+    std::vector<field> fields_;
+    /* sorted whenever names are added, so parses do not modify it */
+    detail::long_name_table<size_t> long_;
+    std::array<size_t, 256> short_;
+    size_t free_args_{NOT_FOUND};
+    size_t help_index_{NOT_FOUND};
+    std::string title_;
+    bool abbreviations_{false};
 };
 
+template<typename Struct, typename... Ts>
+struct_parser(const field_spec<Struct, Ts>&...) -> struct_parser<Struct>;
+
 } // namespace cpparg
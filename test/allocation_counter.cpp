@@ -0,0 +1,38 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local size_t allocations = 0;
+
+} // namespace
+
+namespace cpparg::test {
+
+allocation_counter::allocation_counter()
+    : start_(allocations) {
+}
+
+size_t allocation_counter::count() const {
+    return allocations - start_;
+}
+
+} // namespace cpparg::test
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
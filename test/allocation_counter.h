@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+namespace cpparg::test {
+
+/* Counts global operator new calls made by the current thread while alive */
+class allocation_counter {
+public:
+    allocation_counter();
+
+    size_t count() const;
+
+private:
+    size_t start_;
+};
+
+} // namespace cpparg::test
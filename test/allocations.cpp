@@ -0,0 +1,265 @@
+#include "allocation_counter.h"
+#include "args_builder.h"
+#include <cpparg/cpparg.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Steady-state parsing with an already built parser should not touch the heap */
+
+TEST(allocations, counter) {
+    cpparg::test::allocation_counter counter;
+    auto ptr = std::make_unique<int>(42);
+    EXPECT_EQ(counter.count(), 1u);
+}
+
+TEST(allocations, parse_options) {
+    cpparg::parser parser("allocations::parse_options test");
+
+    int i = 0;
+    double d = 0;
+    bool f = false;
+    std::string_view s;
+    parser.add('i', "int").store(i);
+    parser.add('d', "double").store(d).default_value(1.5);
+    parser.add('f', "flag").flag(f);
+    parser.add("string").store(s);
+    parser.positional("positional").store(i);
+
+    cpparg::test::args_builder builder("./program");
+    builder.add("10").add("-i", "123").add("--string", "some long string value").add("-f");
+    auto [argc, argv] = builder.get();
+
+    cpparg::test::allocation_counter counter;
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(counter.count(), 0u);
+    EXPECT_EQ(i, 123);
+    EXPECT_EQ(d, 1.5);
+}
+
+TEST(allocations, option_forms) {
+    cpparg::parser parser("allocations::option_forms test");
+
+    int i = 0;
+    int offset = 0;
+    bool a = false;
+    bool b = false;
+    std::string_view s;
+    parser.add('i', "int").store(i);
+    parser.add("offset").store(offset);
+    parser.add('a').flag(a);
+    parser.add('b').flag(b);
+    parser.add('s', "string").store(s);
+
+    cpparg::test::args_builder builder("./program");
+    builder.add("-abi-12").add("--string=some long string value").add("--offset", "-7");
+    auto [argc, argv] = builder.get();
+
+    cpparg::test::allocation_counter counter;
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(counter.count(), 0u);
+    EXPECT_EQ(i, -12);
+    EXPECT_EQ(offset, -7);
+    EXPECT_EQ(s, "some long string value");
+}
+
+TEST(allocations, parse_many_options) {
+    static constexpr size_t COUNT = 1000;
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < COUNT; ++i) {
+        names.push_back("option" + std::to_string(i));
+    }
+
+    cpparg::parser parser("allocations::parse_many_options test");
+    std::vector<int> values(COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+        parser.add(names[i]).store(values[i]).default_value(i);
+    }
+
+    cpparg::test::args_builder builder("./program");
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < COUNT; i += 10) {
+        keys.push_back("--" + names[i]);
+    }
+    for (auto& key : keys) {
+        builder.add(key, "42");
+    }
+    auto [argc, argv] = builder.get();
+
+    /* the seen-options bitset does not fit inline, but keeps its storage between parses */
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+
+    cpparg::test::allocation_counter counter;
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(counter.count(), 0u);
+}
+
+TEST(allocations, append) {
+    cpparg::parser parser("allocations::append test");
+
+    std::vector<int> values;
+    values.reserve(16);
+    parser.add('i', "int").repeatable().append(values);
+
+    cpparg::test::args_builder builder("./program");
+    builder.add("-i", "1").add("-i", "2").add("-i", "3");
+    auto [argc, argv] = builder.get();
+
+    cpparg::test::allocation_counter counter;
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(counter.count(), 0u);
+    EXPECT_EQ(values.size(), 3u);
+}
+
+TEST(allocations, store_list) {
+    cpparg::parser parser("allocations::store_list test");
+
+    std::vector<int> values;
+    parser.add('i', "ids").repeatable().store_list(values);
+
+    cpparg::test::args_builder builder("./program");
+    for (size_t i = 0; i < 2000; ++i) {
+        builder.add("-i", "1,2");
+    }
+    auto [argc, argv] = builder.get();
+
+    /* the list grows geometrically across occurrences */
+    cpparg::test::allocation_counter counter;
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_LT(counter.count(), 20u);
+    EXPECT_EQ(values.size(), 4000u);
+}
+
+TEST(allocations, free_arguments) {
+    cpparg::parser parser("allocations::free_arguments test");
+
+    std::vector<int> values;
+    values.reserve(64);
+    parser.free_arguments("ints").unlimited().store(values);
+
+    cpparg::test::args_builder builder("./program");
+    for (size_t i = 0; i < 64; ++i) {
+        builder.add("12345");
+    }
+    auto [argc, argv] = builder.get();
+
+    /* the internal free arguments list keeps its capacity between parses */
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+
+    cpparg::test::allocation_counter counter;
+    parser.reparse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(counter.count(), 0u);
+    EXPECT_EQ(values.size(), 64u);
+}
+
+TEST(allocations, prescan) {
+    static constexpr size_t COUNT = 10000;
+
+    cpparg::parser parser("allocations::prescan test");
+    parser.prescan();
+
+    std::vector<int> values;
+    std::vector<int> free_values;
+    parser.add('i', "int").repeatable().append(values);
+    parser.free_arguments("ints").unlimited().store(free_values);
+
+    cpparg::test::args_builder builder("./program");
+    for (size_t i = 0; i < COUNT; ++i) {
+        builder.add("-i", "1").add("2");
+    }
+    auto [argc, argv] = builder.get();
+
+    /* the counts, the internal free arguments list and the two destinations, once each */
+    cpparg::test::allocation_counter counter;
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(counter.count(), 4u);
+    EXPECT_EQ(values.size(), COUNT);
+    EXPECT_EQ(values.capacity(), COUNT);
+    EXPECT_EQ(free_values.size(), COUNT);
+    EXPECT_EQ(free_values.capacity(), COUNT);
+}
+
+TEST(allocations, free_args_processor) {
+    cpparg::free_args_processor processor;
+
+    std::vector<int> values;
+    values.reserve(3);
+    processor.unlimited().store(values);
+
+    std::vector<std::string_view> args{"1", "2", "3"};
+    size_t rejected = 0;
+
+    cpparg::test::allocation_counter counter;
+    EXPECT_EQ(processor.parse(args, rejected), cpparg::parse_errc::ok);
+    EXPECT_EQ(counter.count(), 0u);
+}
+
+TEST(allocations, command_parser) {
+    cpparg::command_parser parser("allocations::command_parser test");
+    for (int i = 0; i < 100; ++i) {
+        parser.command("command" + std::to_string(i)).handle([i](int, const char*[]) {
+            return i;
+        });
+    }
+
+    cpparg::test::args_builder builder("./program");
+    builder.add("command42").add("--some", "args");
+    auto [argc, argv] = builder.get();
+
+    cpparg::test::allocation_counter counter;
+    EXPECT_EQ(parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow), 42);
+    EXPECT_EQ(counter.count(), 0u);
+}
+
+TEST(allocations, command_tree) {
+    cpparg::command_parser parser("allocations::command_tree test");
+    auto& db = parser.command("db");
+    for (int i = 0; i < 100; ++i) {
+        auto& shard = db.command("shard" + std::to_string(i));
+        shard.command("rebalance").handle([i](int, const char*[]) {
+            return i;
+        });
+    }
+
+    cpparg::test::args_builder builder("./program");
+    builder.add("db").add("shard42").add("rebalance").add("--now");
+    auto [argc, argv] = builder.get();
+    cpparg::test::args_builder unknown_builder("./program");
+    unknown_builder.add("db").add("shard42").add("unknown");
+    auto [unknown_argc, unknown_argv] = unknown_builder.get();
+
+    cpparg::test::allocation_counter counter;
+    EXPECT_EQ(parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow), 42);
+    EXPECT_FALSE(parser.try_parse(unknown_argc, unknown_argv));
+    EXPECT_EQ(counter.count(), 0u);
+}
+
+TEST(allocations, try_parse_errors) {
+    cpparg::parser parser("allocations::try_parse_errors test");
+
+    int i = 0;
+    parser.add('i', "int").store(i);
+    parser.add("required").required().store(i);
+
+    cpparg::test::args_builder unknown("./program");
+    unknown.add("--unknown");
+    cpparg::test::args_builder invalid("./program");
+    invalid.add("-i", "abc");
+    cpparg::test::args_builder missing("./program");
+    missing.add("-i", "1");
+
+    for (auto* builder : {&unknown, &invalid, &missing}) {
+        auto [argc, argv] = builder->get();
+
+        cpparg::test::allocation_counter counter;
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_FALSE(result);
+        EXPECT_EQ(counter.count(), 0u);
+    }
+}
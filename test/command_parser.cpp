@@ -105,3 +105,176 @@ TEST(command_parser, nested_parsers) {
     auto [argc, argv] = builder.get();
     ASSERT_NO_THROW(parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow));
 }
+
+TEST(command_parser, try_parse) {
+    cpparg::command_parser parser("./path-to-program");
+    parser.command("init").handle([](int, const char*[]) { return 7; });
+
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("init").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_TRUE(result);
+        EXPECT_EQ(result.value(), 7);
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("commit").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::unknown_command);
+        EXPECT_EQ(result.message(), "Unknown command 'commit'.");
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::command_required);
+    }
+}
+
+TEST(command_parser, command_tree) {
+    cpparg::command_parser parser("./tool");
+    auto& db = parser.command("db").description("Manage databases");
+    auto& shard = db.command("shard").description("Manage shards");
+    auto& rebalance = shard.command("rebalance").description("Rebalance shards");
+    rebalance.handle([](int argc, const char* argv[]) {
+        EXPECT_EQ(argc, 2);
+        EXPECT_STREQ(argv[0], "rebalance");
+        EXPECT_STREQ(argv[1], "--now");
+        return 1;
+    });
+    shard.default_command("list").handle([](int argc, const char*[]) { return 10 + argc; });
+    db.command("dump").handle([](int, const char*[]) { return 3; });
+    /* a command with both a handler and subcommands */
+    auto& config = parser.command("config");
+    config.handle([](int argc, const char*[]) { return 100 + argc; });
+    config.command("get").handle([](int, const char*[]) { return 4; });
+
+    auto parse = [&parser](std::vector<const char*> args) {
+        cpparg::test::args_builder builder("./tool");
+        for (const char* arg : args) {
+            builder.add(arg);
+        }
+        auto [argc, argv] = builder.get();
+        return parser.try_parse(argc, argv);
+    };
+
+    EXPECT_EQ(parse({"db", "shard", "rebalance", "--now"}).value(), 1);
+    EXPECT_EQ(parse({"db", "shard"}).value(), 10);
+    EXPECT_EQ(parse({"db", "dump"}).value(), 3);
+    EXPECT_EQ(parse({"config", "get"}).value(), 4);
+    EXPECT_EQ(parse({"config", "--all"}).value(), 102);
+    EXPECT_EQ(parse({"config"}).value(), 101);
+
+    auto unknown = parse({"db", "shard", "rebalanse"});
+    EXPECT_EQ(unknown.error(), cpparg::parse_errc::unknown_command);
+    EXPECT_EQ(unknown.token_index(), 3u);
+    EXPECT_EQ(unknown.message(),
+              "Unknown command 'rebalanse' after 'db shard'. Did you mean 'rebalance'?");
+
+    auto required = parse({"db"});
+    EXPECT_EQ(required.error(), cpparg::parse_errc::command_required);
+    EXPECT_EQ(required.message(), "Command name is required after 'db'.");
+    EXPECT_EQ(parse({"dv"}).message(), "Unknown command 'dv'. Did you mean 'db'?");
+    EXPECT_EQ(parse({"db", "xyz"}).message(), "Unknown command 'xyz' after 'db'.");
+
+    EXPECT_THROW(db.command("shard"), std::logic_error);
+    EXPECT_THROW(shard.default_command("other"), std::logic_error);
+
+    const std::string help = parser.help_message_impl();
+    EXPECT_NE(help.find("db shard rebalance"), std::string::npos);
+    EXPECT_LT(help.find("db shard list"), help.find("db shard rebalance"));
+}
+
+TEST(command_parser, lazy_subparsers) {
+    cpparg::command_parser parser("./tool");
+    int builds = 0;
+    int count = 0;
+    std::string name;
+
+    parser.command("build", [&builds, &count](cpparg::parser& options) {
+        ++builds;
+        options.add('c', "count").required().store(count);
+    }).description("Build things");
+    parser.command("other", [](cpparg::parser&) { FAIL(); }).description("Never selected");
+    auto& greet = parser.command("greet").description("Greet someone");
+    greet.subparser([&name](cpparg::parser& options) {
+        options.add('n', "name").default_value("world").store(name);
+    });
+    greet.handle([&name](int, const char*[]) { return static_cast<int>(name.size()); });
+
+    const std::string help = parser.help_message_impl();
+    EXPECT_NE(help.find("Never selected"), std::string::npos);
+    EXPECT_EQ(builds, 0);
+
+    auto parse = [&parser](std::vector<const char*> args) {
+        cpparg::test::args_builder builder("./tool");
+        for (const char* arg : args) {
+            builder.add(arg);
+        }
+        auto [argc, argv] = builder.get();
+        return parser.try_parse(argc, argv);
+    };
+
+    EXPECT_TRUE(parse({"build", "-c", "3"}));
+    EXPECT_EQ(count, 3);
+    EXPECT_TRUE(parse({"build", "--count", "5"}));
+    EXPECT_EQ(count, 5);
+    EXPECT_EQ(builds, 1);
+
+    auto invalid = parse({"build", "-c", "x"});
+    EXPECT_EQ(invalid.error(), cpparg::parse_errc::invalid_argument);
+    EXPECT_EQ(invalid.token_index(), 3u);
+    EXPECT_EQ(invalid.message(), "Cannot parse option count: invalid value 'x'.");
+    EXPECT_EQ(parse({"build"}).error(), cpparg::parse_errc::required_missing);
+
+    EXPECT_EQ(parse({"greet", "-n", "cpparg"}).value(), 6);
+    /* the cached parser is reset before every use */
+    EXPECT_EQ(parse({"greet"}).value(), 5);
+
+    /* errors of a subparser are explained by its own help */
+    auto error_help = [&parser](std::vector<const char*> args) {
+        cpparg::test::args_builder builder("./tool");
+        for (const char* arg : args) {
+            builder.add(arg);
+        }
+        auto [argc, argv] = builder.get();
+        return parser.error_help_message(argc, argv, parser.try_parse(argc, argv).message());
+    };
+    const std::string build_help = error_help({"build", "--help"});
+    EXPECT_TRUE(cpparg::util::starts_with(build_help, "Unknown option help.\n"));
+    EXPECT_NE(build_help.find("--count"), std::string::npos);
+    /* usage names the program and the command, as for eagerly built subparsers */
+    EXPECT_NE(build_help.find("Usage:\n  ./tool build "), std::string::npos);
+    EXPECT_EQ(build_help.find("Build things"), std::string::npos);
+    EXPECT_NE(error_help({"build"}).find("--count"), std::string::npos);
+    EXPECT_NE(error_help({"unknown"}).find("Build things"), std::string::npos);
+}
+
+TEST(command_parser, complete) {
+    cpparg::command_parser parser("./tool");
+    auto& db = parser.command("db");
+    db.command("shard").command("rebalance");
+    db.command("show");
+    db.command("dump", [](cpparg::parser& options) {
+        options.add('o', "output").handle([](auto) { FAIL(); });
+        options.add("overwrite").no_argument().handle([] { FAIL(); });
+    });
+    parser.default_command("deploy");
+
+    auto complete = [&parser](std::vector<std::string_view> words) {
+        std::stringstream out;
+        parser.complete(words, out);
+        return out.str();
+    };
+
+    EXPECT_EQ(complete({""}), "db\ndeploy\n");
+    EXPECT_EQ(complete({}), "db\ndeploy\n");
+    EXPECT_EQ(complete({"d"}), "db\ndeploy\n");
+    EXPECT_EQ(complete({"db", "s"}), "shard\nshow\n");
+    EXPECT_EQ(complete({"db", "shard", ""}), "rebalance\n");
+    EXPECT_EQ(complete({"db", "dump", "--o"}), "--output\n--overwrite\n");
+    EXPECT_EQ(complete({"db", "dump", "--output", ""}), "");
+    EXPECT_EQ(complete({"db", "unknown", ""}), "");
+    EXPECT_EQ(complete({"deploy", ""}), "");
+}
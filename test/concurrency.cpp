@@ -0,0 +1,384 @@
+#include "args_builder.h"
+#include <cpparg/cpparg.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct point {
+    int x;
+    int y;
+};
+
+std::istream& operator>>(std::istream& is, point& p) {
+    return is >> p.x >> p.y;
+}
+
+std::ostream& operator<<(std::ostream& os, const point& p) {
+    return os << p.x << ' ' << p.y;
+}
+
+/* Reports bad input by throwing instead of failing the stream */
+struct strict_int {
+    int value = 0;
+};
+
+std::istream& operator>>(std::istream& is, strict_int& v) {
+    std::string text;
+    is >> text;
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::runtime_error("not an int: " + text);
+    }
+    v.value = std::stoi(text);
+    return is;
+}
+
+struct segment {
+    point from;
+    point to;
+};
+
+/* Converts its parts through cpparg::util again while the outer conversion is running */
+std::istream& operator>>(std::istream& is, segment& s) {
+    std::string line;
+    std::getline(is, line);
+    size_t pos = line.find(';');
+    s.from = cpparg::util::from_string<point>(std::string_view(line).substr(0, pos));
+    s.to = cpparg::util::from_string<point>(std::string_view(line).substr(pos + 1));
+    return is;
+}
+
+std::ostream& operator<<(std::ostream& os, const segment& s) {
+    return os << cpparg::util::to_string(s.from) << ';' << cpparg::util::to_string(s.to);
+}
+
+/* Round-trips values through both charconv and istream-based conversions */
+bool parse_once(int seed) {
+    cpparg::parser parser("concurrency test");
+
+    int i = 0;
+    double d = 0;
+    point p{0, 0};
+    point def{0, 0};
+    std::vector<long> v;
+    std::vector<int> free_args;
+
+    parser.add('i', "int").store(i);
+    parser.add('d', "double").store(d);
+    parser.add('p', "point").store(p);
+    parser.add("default").store(def).default_value(point{seed, -seed});
+    parser.add('a', "append").repeatable().append(v);
+    parser.free_arguments("ints").unlimited().store(free_args);
+
+    std::string si = std::to_string(seed);
+    std::string sd = cpparg::util::to_string(seed + 0.5);
+    std::string sp = cpparg::util::join(seed, ' ', seed * 2);
+    std::string sa = cpparg::util::to_string(seed * 3);
+
+    cpparg::test::args_builder builder("./program");
+    builder.add("-i", si).add("--double", sd).add("--point", sp);
+    builder.add("-a", sa).add("-a", sa).add(si).add(si);
+    auto [argc, argv] = builder.get();
+
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+
+    return i == seed && d == seed + 0.5 && p.x == seed && p.y == seed * 2 && def.x == seed &&
+           def.y == -seed && v == std::vector<long>{seed * 3, seed * 3} &&
+           free_args == std::vector<int>{seed, seed};
+}
+
+} // namespace
+
+TEST(concurrency, parallel_parsers) {
+    const size_t threads_count = std::max(4u, std::thread::hardware_concurrency());
+    static constexpr int ITERATIONS = 2000;
+
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_count; ++t) {
+        threads.emplace_back([t, &failures] {
+            for (int it = 0; it < ITERATIONS; ++it) {
+                if (!parse_once(static_cast<int>(t * ITERATIONS + it))) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(failures.load(), 0u);
+}
+
+TEST(concurrency, nested_conversions) {
+    segment s = cpparg::util::from_string<segment>("1 2;3 4");
+    EXPECT_EQ(s.from.x, 1);
+    EXPECT_EQ(s.from.y, 2);
+    EXPECT_EQ(s.to.x, 3);
+    EXPECT_EQ(s.to.y, 4);
+    EXPECT_EQ(cpparg::util::to_string(s), "1 2;3 4");
+}
+
+TEST(concurrency, shared_compiled_parser) {
+    int i = 0;
+    point p{0, 0};
+    std::vector<long> v;
+    std::vector<int> free_args;
+
+    cpparg::parser parser("concurrency test");
+    parser.add('i', "int").store(i);
+    parser.add('p', "point").store(p).default_value(point{-1, -1});
+    parser.add('a', "append").repeatable().append(v);
+    parser.free_arguments("ints").unlimited().store(free_args);
+    const cpparg::compiled_parser compiled = parser.compile();
+
+    const size_t threads_count = std::max(4u, std::thread::hardware_concurrency());
+    static constexpr int ITERATIONS = 2000;
+
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_count; ++t) {
+        threads.emplace_back([t, &compiled, &failures] {
+            cpparg::compiled_parser::arguments args;
+            for (int it = 0; it < ITERATIONS; ++it) {
+                const int seed = static_cast<int>(t * ITERATIONS + it);
+                std::string si = std::to_string(seed);
+                std::string sa = std::to_string(seed * 3);
+
+                cpparg::test::args_builder builder("./program");
+                builder.add("-i", si).add("-a", sa).add("-a", si).add(si);
+                auto [argc, argv] = builder.get();
+                compiled.try_parse(argc, argv, args);
+
+                point def = *args.get<point>("point");
+                bool ok = args.get<int>("int") == seed && def.x == -1 && def.y == -1 &&
+                          args.get_all<long>("append") == std::vector<long>{seed * 3, seed} &&
+                          args.free_args() == std::vector<std::string_view>{si};
+                if (!ok) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(failures.load(), 0u);
+    /* the parser's own targets are never touched */
+    EXPECT_EQ(i, 0);
+    EXPECT_TRUE(v.empty());
+    EXPECT_TRUE(free_args.empty());
+}
+
+TEST(concurrency, parallel_for) {
+    static constexpr size_t COUNT = 100000;
+    std::vector<std::atomic<int>> visits(COUNT);
+    std::atomic<size_t> max_worker{0};
+
+    /* uneven work makes the idle workers steal */
+    cpparg::detail::parallel_for(COUNT, 8, [&](size_t worker, size_t i) {
+        size_t seen = max_worker.load();
+        while (seen < worker && !max_worker.compare_exchange_weak(seen, worker)) {
+        }
+        if (i < COUNT / 8) {
+            std::this_thread::yield();
+        }
+        ++visits[i];
+    });
+
+    EXPECT_LT(max_worker.load(), 8u);
+    EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](const auto& v) { return v == 1; }));
+
+    size_t calls = 0;
+    cpparg::detail::parallel_for(0, 4, [&calls](size_t, size_t) { ++calls; });
+    cpparg::detail::parallel_for(3, 0, [&calls](size_t, size_t) { ++calls; });
+    EXPECT_EQ(calls, 3u);
+}
+
+TEST(concurrency, store_list) {
+    const size_t count = cpparg::detail::PARALLEL_LIST_SIZE * 4 + 1;
+    std::string list;
+    for (size_t i = 0; i < count; ++i) {
+        list += std::to_string(i * 7) + ',';
+    }
+    list.pop_back();
+
+    cpparg::parser parser("concurrency::store_list test");
+    std::vector<long> ids{-1};
+    parser.add("ids").repeatable().store_list(ids, ',', 4);
+
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("--ids", list).get();
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    ASSERT_EQ(ids.size(), count + 1);
+    EXPECT_EQ(ids[0], -1);
+    for (size_t i = 0; i < count; ++i) {
+        ASSERT_EQ(ids[i + 1], static_cast<long>(i * 7));
+    }
+
+    list[list.size() / 2] = 'x';
+    cpparg::test::args_builder invalid("./program");
+    auto [invalid_argc, invalid_argv] = invalid.add("--ids", list).get();
+    EXPECT_FALSE(parser.try_parse(invalid_argc, invalid_argv));
+    EXPECT_EQ(ids.size(), count + 1);
+
+    /*
+     * exceptions of the workers reach the caller, which try_parse reports;
+     * as on one thread, the list fails on its first bad element
+     */
+    std::string strict_list;
+    for (size_t i = 0; i < count; ++i) {
+        strict_list += i == count / 4 ? "early," : i == count * 3 / 4 ? "late," : "1,";
+    }
+    strict_list.pop_back();
+    cpparg::parser strict_parser("concurrency::store_list strict test");
+    std::vector<strict_int> strict;
+    strict_parser.add("ids").store_list(strict, ',', 4);
+    cpparg::test::args_builder strict_builder("./program");
+    auto [strict_argc, strict_argv] = strict_builder.add("--ids", strict_list).get();
+    for (size_t attempt = 0; attempt < 10; ++attempt) {
+        auto result = strict_parser.try_parse(strict_argc, strict_argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::handler_error);
+        EXPECT_EQ(result.token_index(), 2u);
+        EXPECT_EQ(result.message(), "not an int: early");
+        EXPECT_TRUE(strict.empty());
+    }
+    EXPECT_THROW(
+        strict_parser.parse(strict_argc, strict_argv, cpparg::parsing_error_policy::rethrow),
+        std::runtime_error);
+}
+
+TEST(concurrency, convert_list_sequential_exception) {
+    /* short lists and single threads take the sequential path, which rolls back the same way */
+    std::vector<strict_int> dest(2);
+    EXPECT_THROW(cpparg::detail::convert_list("1,2,bad,4", ',', dest, 1), std::runtime_error);
+    EXPECT_EQ(dest.size(), 2u);
+    EXPECT_THROW(cpparg::detail::convert_list("1,2,3,bad", ',', dest, 4), std::runtime_error);
+    EXPECT_EQ(dest.size(), 2u);
+    ASSERT_TRUE(cpparg::detail::convert_list("1,2", ',', dest, 1));
+    ASSERT_EQ(dest.size(), 4u);
+    EXPECT_EQ(dest[3].value, 2);
+
+    cpparg::parser parser("concurrency::convert_list_sequential_exception test");
+    std::vector<strict_int> ids;
+    parser.add('i', "ids").repeatable().store_list(ids, ',');
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("-i", "1,2").add("-i", "3,x").get();
+    auto result = parser.try_parse(argc, argv);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::handler_error);
+    EXPECT_EQ(result.message(), "not an int: x");
+    ASSERT_EQ(ids.size(), 2u);
+    EXPECT_EQ(ids[1].value, 2);
+}
+
+TEST(concurrency, parse_many) {
+    cpparg::parser parser("concurrency test");
+    parser.add('i', "int").required().check<int>();
+    parser.add('p', "point").check<point>().default_value(point{-1, -1});
+    parser.add('a', "append").repeatable().check<long>();
+    const cpparg::compiled_parser compiled = parser.compile();
+
+    static constexpr int COUNT = 20000;
+    std::vector<cpparg::command_line> inputs(COUNT);
+    for (int i = 0; i < COUNT; ++i) {
+        std::string value = i % 10 == 7 ? "broken" : std::to_string(i);
+        inputs[i].split(cpparg::util::join("./program -i ", value, " -a ", i, " -a ", i * 2));
+    }
+
+    struct output {
+        int i = 0;
+        point p{0, 0};
+        std::vector<long> a;
+    };
+
+    std::vector<output> outputs;
+    auto results = compiled.parse_many(
+        inputs,
+        outputs,
+        [](const cpparg::compiled_parser::arguments& args, output& out) {
+            out.i = *args.get<int>("int");
+            out.p = *args.get<point>("point");
+            out.a = args.get_all<long>("append");
+            if (out.i == 5) {
+                throw std::runtime_error("five");
+            }
+            if (out.i == 6) {
+                throw 6;
+            }
+        },
+        4);
+
+    ASSERT_EQ(results.size(), static_cast<size_t>(COUNT));
+    ASSERT_EQ(outputs.size(), static_cast<size_t>(COUNT));
+    for (int i = 0; i < COUNT; ++i) {
+        if (i % 10 == 7) {
+            EXPECT_EQ(results[i].error(), cpparg::parse_errc::invalid_argument);
+            EXPECT_EQ(results[i].message(), "Cannot parse option int: invalid value 'broken'.");
+        } else if (i == 5) {
+            EXPECT_EQ(results[i].error(), cpparg::parse_errc::handler_error);
+            EXPECT_EQ(results[i].message(), "five");
+        } else if (i == 6) {
+            EXPECT_EQ(results[i].error(), cpparg::parse_errc::handler_error);
+            EXPECT_EQ(results[i].message(), "Handler threw an unknown exception.");
+        } else {
+            ASSERT_TRUE(results[i]) << results[i].message();
+            EXPECT_EQ(outputs[i].i, i);
+            EXPECT_EQ(outputs[i].p.x, -1);
+            EXPECT_EQ(outputs[i].a, (std::vector<long>{i, i * 2}));
+        }
+    }
+}
+
+TEST(concurrency, parse_many_shares_threads) {
+    cpparg::parser parser("concurrency test");
+    parser.add('i', "int").required().check<int>();
+    const cpparg::compiled_parser compiled = parser.compile();
+
+    static constexpr int COUNT = 2000;
+    std::vector<cpparg::command_line> inputs(COUNT);
+    for (int i = 0; i < COUNT; ++i) {
+        inputs[i].split(cpparg::util::join("./program -i ", i));
+    }
+
+    /* calls from several threads at once, each converting a list in parallel as well */
+    auto parse = [&compiled, &inputs] {
+        std::vector<int> outputs;
+        auto results = compiled.parse_many(
+            inputs,
+            outputs,
+            [](const cpparg::compiled_parser::arguments& args, int& out) {
+                out = *args.get<int>("int");
+                if (out % 500 == 0) {
+                    std::string list = "1";
+                    for (size_t k = 1; k < cpparg::detail::PARALLEL_LIST_SIZE; ++k) {
+                        list += ",1";
+                    }
+                    std::vector<int> ones;
+                    ASSERT_TRUE(cpparg::detail::convert_list(list, ',', ones, 3));
+                    ASSERT_EQ(ones.size(), cpparg::detail::PARALLEL_LIST_SIZE);
+                }
+            },
+            4);
+        for (int i = 0; i < COUNT; ++i) {
+            ASSERT_TRUE(results[i]) << results[i].message();
+            ASSERT_EQ(outputs[i], i);
+        }
+    };
+
+    for (int round = 0; round < 3; ++round) {
+        std::vector<std::thread> callers;
+        for (int t = 0; t < 3; ++t) {
+            callers.emplace_back(parse);
+        }
+        for (auto& caller : callers) {
+            caller.join();
+        }
+    }
+}
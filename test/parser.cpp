@@ -3,8 +3,14 @@
 
 #include <gtest/gtest.h>
 
+#include <deque>
+#include <fstream>
 #include <numeric>
 
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
 TEST(parser, no_arguments) {
     cpparg::parser parser("parser::no_arguments test");
     parser.title("Test parser with no arguments");
@@ -273,6 +279,117 @@ TEST(parser, flag) {
     EXPECT_EQ(flags[3], true);
 }
 
+TEST(parser, option_forms) {
+    cpparg::parser parser("parser::option_forms test");
+
+    bool a = false;
+    bool b = false;
+    std::string output;
+    int jobs = 0;
+    int offset = 0;
+    double scale = 0;
+    std::string positional;
+    parser.positional("positional").store(positional);
+    parser.add('a', "all").flag(a);
+    parser.add('b').flag(b);
+    parser.add('o', "output").store(output);
+    parser.add('j', "jobs").store(jobs);
+    parser.add("offset").store(offset);
+    parser.add("scale").store(scale);
+
+    auto parse = [&parser](std::vector<std::string> args) {
+        cpparg::test::args_builder builder("./program");
+        for (auto& arg : args) {
+            builder.add(arg);
+        }
+        auto [argc, argv] = builder.get();
+        auto result = parser.try_parse(argc, argv);
+        return result ? std::string{} : result.message();
+    };
+
+    EXPECT_EQ(parse({"-abj8", "-ofile", "--offset", "-5", "--scale=-.5", "-7"}), "");
+    EXPECT_TRUE(a && b);
+    EXPECT_EQ(jobs, 8);
+    EXPECT_EQ(output, "file");
+    EXPECT_EQ(offset, -5);
+    EXPECT_DOUBLE_EQ(scale, -0.5);
+    EXPECT_EQ(positional, "-7");
+
+    EXPECT_EQ(parse({"-bo", "-", "--jobs=3"}), "");
+    EXPECT_EQ(output, "-");
+    EXPECT_EQ(jobs, 3);
+    EXPECT_FALSE(a);
+
+    EXPECT_EQ(parse({"-ab", "--output="}), "Cannot parse option output: argument required.");
+    EXPECT_EQ(parse({"--all=yes"}), "Cannot parse option all: invalid value 'yes'.");
+    EXPECT_EQ(parse({"-axb"}), "Unknown option x.");
+    EXPECT_EQ(parse({"-aba"}), "Option 'a' is not repeatable");
+    EXPECT_EQ(parse({"-j", "-a"}), "Cannot parse option jobs: argument required.");
+    EXPECT_EQ(parse({"-j-1"}), "");
+    EXPECT_EQ(jobs, -1);
+
+    /* a short option named by a digit wins over a negative number */
+    int five = 0;
+    parser.add('5').store_value(five, 5);
+    EXPECT_EQ(parse({"-5"}), "");
+    EXPECT_EQ(five, 5);
+    /* also when the option before it takes a value, which can still be attached */
+    EXPECT_EQ(parse({"--offset", "-5"}), "Cannot parse option offset: argument required.");
+    EXPECT_EQ(parse({"-j", "-5"}), "Cannot parse option jobs: argument required.");
+    EXPECT_EQ(parse({"--offset=-5", "-j-5"}), "");
+    EXPECT_EQ(offset, -5);
+    EXPECT_EQ(jobs, -5);
+    EXPECT_EQ(parse({"--offset", "-6"}), "");
+    EXPECT_EQ(offset, -6);
+
+    auto compiled = parser.compile();
+    cpparg::compiled_parser::arguments args;
+    const std::vector<std::string_view> argv{"./program", "-5", "-bj2", "--output=x", "-6"};
+    ASSERT_TRUE(compiled.try_parse(argv, args)) << compiled.try_parse(argv, args).message();
+    EXPECT_TRUE(args.has("5"));
+    EXPECT_TRUE(args.has("b"));
+    EXPECT_EQ(args.get<int>("jobs"), 2);
+    EXPECT_EQ(args.value("output"), "x");
+    EXPECT_EQ(args.value("positional"), "-6");
+
+    auto result =
+        compiled.try_parse(std::vector<std::string_view>{"./program", "--offset", "-5"}, args);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::argument_required);
+    result = compiled.try_parse(std::vector<std::string_view>{"./program", "-j", "-5"}, args);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::argument_required);
+}
+
+TEST(parser, store_list) {
+    cpparg::parser parser("parser::store_list test");
+
+    std::vector<int> ids;
+    std::vector<std::string> names;
+    std::vector<bool> bits;
+    parser.add('i', "ids").repeatable().store_list(ids);
+    parser.add("names").store_list(names, ';');
+    parser.add("bits").store_list(bits, ':');
+
+    /* long enough for the vectorized scan, with a delimiter in the scalar tail */
+    cpparg::test::args_builder builder("./program");
+    builder.add("--ids", "1,-2,30,400,5000,60000,700000,8").add("-i9");
+    builder.add("--names=a b;;c").add("--bits", "1:0:1");
+    auto [argc, argv] = builder.get();
+
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(ids, (std::vector<int>{1, -2, 30, 400, 5000, 60000, 700000, 8, 9}));
+    EXPECT_EQ(names, (std::vector<std::string>{"a b", "", "c"}));
+    EXPECT_EQ(bits, (std::vector<bool>{true, false, true}));
+
+    cpparg::test::args_builder invalid("./program");
+    auto [invalid_argc, invalid_argv] = invalid.add("-i", "1,2").add("-i", "3,x,4").get();
+    ids.clear();
+    auto result = parser.try_parse(invalid_argc, invalid_argv);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::invalid_argument);
+    EXPECT_EQ(result.message(), "Cannot parse option ids: invalid value '3,x,4'.");
+    /* the rejected list leaves nothing behind */
+    EXPECT_EQ(ids, (std::vector<int>{1, 2}));
+}
+
 TEST(parser, store_value) {
     cpparg::parser parser("parser::store_value test");
 
@@ -309,3 +426,645 @@ TEST(parser, explicit_store) {
 
     EXPECT_EQ(i, 42);
 }
+
+TEST(parser, duplicate_names) {
+    cpparg::parser parser("parser::duplicate_names test");
+
+    parser.add('i', "int").handle([](auto) {});
+    EXPECT_THROW(parser.add("int"), std::logic_error);
+    EXPECT_THROW(parser.add('i'), std::logic_error);
+    EXPECT_NO_THROW(parser.add('j', "integer").handle([](auto) {}));
+}
+
+TEST(parser, many_options) {
+    cpparg::parser parser("parser::many_options test");
+
+    static constexpr size_t COUNT = 1000;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < COUNT; ++i) {
+        names.push_back("option" + std::to_string(i));
+    }
+
+    std::vector<int> values(COUNT, -1);
+    for (size_t i = 0; i < COUNT; ++i) {
+        auto& p = parser.add(names[i]).store(values[i]);
+        if (i % 3 == 0) {
+            p.default_value(i);
+        }
+    }
+    parser.add("required").required().handle([](auto) {});
+
+    cpparg::test::args_builder builder("./program");
+    builder.add("--option1", "1").add("--option3", "3").add("--option998", "998");
+    auto [argc, argv] = builder.get();
+    EXPECT_THROW(
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow),
+        cpparg::parser_error);
+
+    builder.add("--required", "yes");
+    std::tie(argc, argv) = builder.get();
+    EXPECT_NO_THROW(parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow));
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        if (i == 1 || i == 998 || i % 3 == 0) {
+            EXPECT_EQ(values[i], static_cast<int>(i));
+        } else {
+            EXPECT_EQ(values[i], -1);
+        }
+    }
+}
+
+TEST(parser, try_parse) {
+    cpparg::parser parser("parser::try_parse test");
+
+    int i = 0;
+    std::vector<int> free_args;
+    parser.add('i', "int").store(i);
+    auto& req = parser.add("required").required().handle([](auto) {});
+    parser.free_arguments("ints").max(1).store(free_args);
+
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("--required", "x").add("-i", "12").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_TRUE(result);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::ok);
+        EXPECT_EQ(i, 12);
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("--required", "x").add("--unknown").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::unknown_option);
+        EXPECT_EQ(result.token_index(), 3u);
+        EXPECT_EQ(result.message(), "Unknown option unknown.");
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("--required", "x").add("-i", "abc").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::invalid_argument);
+        EXPECT_EQ(result.token_index(), 4u);
+        EXPECT_EQ(result.token(), "abc");
+        EXPECT_EQ(result.message(), "Cannot parse option int: invalid value 'abc'.");
+        EXPECT_THROW(
+            parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow),
+            cpparg::processor_error);
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("-i", "1").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::required_missing);
+        EXPECT_EQ(result.source(), &req);
+        EXPECT_EQ(result.token_index(), cpparg::parse_result::NO_TOKEN);
+        EXPECT_EQ(result.message(), "Option required is required.");
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("--required", "x").add("1").add("2").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::too_many_free_arguments);
+        EXPECT_EQ(result.message(), "Invalid free arguments count, got 2 while maximum is 1");
+        EXPECT_THROW(
+            parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow),
+            cpparg::invalid_free_arguments_count);
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("--required", "x").add("one").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::invalid_argument);
+        EXPECT_EQ(result.token_index(), 3u);
+        EXPECT_EQ(result.source(), nullptr);
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("--required", "x").add("-i", "1").add("-i", "2").get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::not_repeatable);
+        EXPECT_EQ(result.token_index(), 5u);
+    }
+}
+
+TEST(parser, try_parse_handler_error) {
+    cpparg::parser parser("parser::try_parse_handler_error test");
+
+    parser.add("fail").handle([](std::string_view) {
+        throw cpparg::parser_error("handler failed");
+    });
+
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("--fail", "now").get();
+    auto result = parser.try_parse(argc, argv);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::handler_error);
+    EXPECT_EQ(result.token_index(), 2u);
+    EXPECT_EQ(result.message(), "handler failed");
+
+    /* any other exception is captured as well */
+    parser.add("throw").handle([](std::string_view arg) {
+        if (arg == "std") {
+            throw std::runtime_error("runtime error");
+        }
+        throw 42;
+    });
+    cpparg::test::args_builder std_builder("./program");
+    auto [std_argc, std_argv] = std_builder.add("--throw", "std").get();
+    result = parser.try_parse(std_argc, std_argv);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::handler_error);
+    EXPECT_EQ(result.token_index(), 2u);
+    EXPECT_EQ(result.message(), "runtime error");
+
+    cpparg::test::args_builder other_builder("./program");
+    auto [other_argc, other_argv] = other_builder.add("--throw", "other").get();
+    result = parser.try_parse(other_argc, other_argv);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::handler_error);
+    EXPECT_EQ(result.message(), "Handler threw an unknown exception.");
+    EXPECT_THROW(
+        parser.parse(std_argc, std_argv, cpparg::parsing_error_policy::rethrow),
+        std::runtime_error);
+}
+
+TEST(parser, reparse) {
+    cpparg::parser parser("parser::reparse test");
+
+    int i;
+    std::string s;
+    bool f = false;
+    std::vector<int> v;
+    std::vector<int> free_args;
+    int custom = 0;
+
+    parser.add('i', "int").store(i);
+    parser.add('s', "string").store(s);
+    parser.add('f', "flag").flag(f);
+    /* targets are first read by the first parse, so they may be set after registration */
+    i = -1;
+    s = "initial, long enough to be allocated";
+    parser.add('a', "append").repeatable().append(v);
+    parser.add('c', "custom").handle<int>([&custom](int x) { custom += x; }).on_reset([&custom] {
+        custom = 0;
+    });
+    parser.free_arguments("ints").unlimited().store(free_args);
+
+    cpparg::test::args_builder first("./program");
+    first.add("-i", "1").add("-s", "first").add("-f").add("-a", "1").add("-a", "2");
+    first.add("-c", "5").add("10").add("20");
+    auto [argc1, argv1] = first.get();
+    parser.reparse(argc1, argv1, cpparg::parsing_error_policy::rethrow);
+
+    EXPECT_EQ(i, 1);
+    EXPECT_EQ(s, "first");
+    EXPECT_TRUE(f);
+    EXPECT_EQ(v, (std::vector<int>{1, 2}));
+    EXPECT_EQ(custom, 5);
+    EXPECT_EQ(free_args, (std::vector<int>{10, 20}));
+
+    cpparg::test::args_builder second("./program");
+    second.add("-a", "3").add("30");
+    auto [argc2, argv2] = second.get();
+    EXPECT_TRUE(parser.try_reparse(argc2, argv2));
+
+    EXPECT_EQ(i, -1);
+    EXPECT_EQ(s, "initial, long enough to be allocated");
+    EXPECT_FALSE(f);
+    EXPECT_EQ(v, (std::vector<int>{3}));
+    EXPECT_EQ(custom, 0);
+    EXPECT_EQ(free_args, (std::vector<int>{30}));
+
+    parser.parse(argc1, argv1, cpparg::parsing_error_policy::rethrow);
+    parser.reset();
+    EXPECT_EQ(i, -1);
+    EXPECT_EQ(s, "initial, long enough to be allocated");
+}
+
+TEST(parser, reset_after_parse) {
+    cpparg::parser parser("parser::reset_after_parse test");
+
+    int port = 8080;
+    int num = 5;
+    std::string name = "initial, long enough to be allocated";
+    parser.add("port").store(port);
+    parser.add("num").store(num);
+    parser.add("name").store(name);
+
+    cpparg::test::args_builder args("./program");
+    args.add("--port", "9").add("--num", "7").add("--name", "parsed");
+    auto [argc, argv] = args.get();
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(port, 9);
+
+    parser.reset();
+    EXPECT_EQ(port, 8080);
+    EXPECT_EQ(num, 5);
+    EXPECT_EQ(name, "initial, long enough to be allocated");
+
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    cpparg::test::args_builder empty("./program");
+    auto [empty_argc, empty_argv] = empty.get();
+    EXPECT_TRUE(parser.try_reparse(empty_argc, empty_argv));
+    EXPECT_EQ(port, 8080);
+    EXPECT_EQ(num, 5);
+    EXPECT_EQ(name, "initial, long enough to be allocated");
+}
+
+TEST(parser, standalone_processor) {
+    /* processors made outside of a parser own their strings and stay valid when moved */
+    int value = 0;
+    cpparg::processor option('v', std::string("value"));
+    option.store(value).description(std::string("Some value")).default_value(3);
+    cpparg::processor moved = std::move(option);
+    moved.value_type("int");
+    cpparg::processor positional(size_t{0}, "input");
+    EXPECT_THROW(cpparg::processor("-bad"), std::logic_error);
+}
+
+TEST(parser, compile) {
+    std::string name;
+    int number = 0;
+    bool quiet = false;
+    cpparg::compiled_parser compiled = [&name, &number, &quiet] {
+        cpparg::parser parser("parser::compile test");
+        parser.title("Compiled");
+        parser.positional("name").required().store(name);
+        parser.add('n', "number").store(number).default_value(7);
+        parser.add('q', "quiet").flag(quiet);
+        parser.add('v').no_argument().handle([] {});
+        parser.add("list").repeatable().handle<double>([](double) {});
+        parser.add_help('h', "help");
+        parser.free_arguments("args").max(1);
+        return parser.compile();
+    }();
+
+    EXPECT_TRUE(cpparg::util::starts_with(compiled.help_message(), "Compiled\n"));
+    cpparg::compiled_parser::arguments args;
+    {
+        cpparg::test::args_builder builder("./program");
+        builder.add("first", "-vq").add("--list", "1.5").add("--list", "2");
+        auto [argc, argv] = builder.get();
+        ASSERT_TRUE(compiled.try_parse(argc, argv, args));
+        EXPECT_EQ(args.value("name"), "first");
+        EXPECT_EQ(args.get<bool>("quiet"), true);
+        EXPECT_EQ(args.get<bool>("v"), true);
+        EXPECT_EQ(args.get<int>("number"), 7);
+        EXPECT_EQ(args.count("v"), 1u);
+        EXPECT_EQ(args.get_all<double>("list"), (std::vector<double>{1.5, 2}));
+        EXPECT_FALSE(args.help_requested());
+        EXPECT_TRUE(args.free_args().empty());
+        EXPECT_THROW(args.count("unknown"), std::logic_error);
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("first", "-h").add("second").get();
+        ASSERT_TRUE(compiled.try_parse(argc, argv, args));
+        EXPECT_TRUE(args.help_requested());
+        EXPECT_FALSE(args.has("v"));
+        EXPECT_EQ(args.get<bool>("quiet"), false);
+        EXPECT_EQ(args.value("quiet"), std::nullopt);
+        EXPECT_EQ(args.free_args(), (std::vector<std::string_view>{"second"}));
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("first", "--number").add("x").get();
+        auto result = compiled.try_parse(argc, argv, args);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::invalid_argument);
+        EXPECT_EQ(result.token_index(), 3u);
+        EXPECT_EQ(result.message(), "Cannot parse option number: invalid value 'x'.");
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("-v").get();
+        EXPECT_EQ(compiled.try_parse(argc, argv, args).message(), "Option name is required.");
+        EXPECT_THROW(compiled.parse(argc, argv), cpparg::processor_error);
+    }
+    EXPECT_TRUE(name.empty());
+    EXPECT_EQ(number, 0);
+    EXPECT_FALSE(quiet);
+
+}
+
+TEST(parser, compile_shared_names) {
+    /* names of long options, positionals and short options are looked up in this order */
+    cpparg::parser parser("parser::compile_shared_names test");
+    parser.positional("input").handle([](auto) {});
+    parser.add("input").handle([](auto) {});
+    parser.add('v').no_argument().handle([] {});
+    parser.add("v").handle([](auto) {});
+    parser.positional("target").handle([](auto) {});
+    parser.add('t').no_argument().handle([] {});
+    parser.abbreviations();
+    auto compiled = parser.compile();
+
+    cpparg::compiled_parser::arguments args;
+    const std::vector<std::string_view> argv{
+        "./program", "in.txt", "out.txt", "--input", "flag.txt", "-v", "-t", "--v", "value"};
+    ASSERT_TRUE(compiled.try_parse(argv, args)) << compiled.try_parse(argv, args).message();
+    EXPECT_EQ(args.value("input"), "flag.txt");
+    EXPECT_EQ(args.value("v"), "value");
+    EXPECT_EQ(args.value("target"), "out.txt");
+    EXPECT_TRUE(args.has("t"));
+    EXPECT_EQ(args.count("v"), 1u);
+
+    ASSERT_TRUE(compiled.try_parse(
+        std::vector<std::string_view>{"./program", "in.txt", "--in", "flag.txt"}, args));
+    EXPECT_EQ(args.value("input"), "flag.txt");
+}
+
+TEST(parser, compiled_handles) {
+    cpparg::parser parser("parser::compiled_handles test");
+    int number = 0;
+    std::string text;
+    parser.add('n', "number").store(number).default_value(7);
+    parser.add("text").repeatable().store(text);
+    parser.add("missing").store(text);
+    bool verbose = false;
+    parser.add('v', "verbose").flag(verbose);
+    auto compiled = parser.compile(false);
+
+    const auto number_handle = compiled.option_handle("number");
+    const auto text_handle = compiled.option_handle("text");
+    const auto missing_handle = compiled.option_handle("missing");
+    const auto verbose_handle = compiled.option_handle("verbose");
+    EXPECT_THROW(compiled.option_handle("unknown"), std::logic_error);
+
+    cpparg::compiled_parser::arguments args;
+    const std::vector<std::string_view> argv{"./program", "--text", "a", "--text=b"};
+    ASSERT_TRUE(compiled.try_parse(argv, args));
+    EXPECT_FALSE(args.has(number_handle));
+    EXPECT_TRUE(args.has(text_handle));
+    EXPECT_EQ(args.get<int>(number_handle), 7);
+    EXPECT_EQ(args.value(text_handle), "b");
+    EXPECT_FALSE(args.get<std::string>(missing_handle));
+    EXPECT_EQ(args.get<bool>(verbose_handle), false);
+
+    /* memoized until the next parse */
+    const std::optional<std::string>& first = args.get<std::string>(text_handle);
+    EXPECT_EQ(&first, &args.get<std::string>(text_handle));
+    EXPECT_EQ(first, "b");
+    EXPECT_EQ(args.get<char>(text_handle), 'b');
+
+    /* not validated while parsing, so the conversion fails on access */
+    ASSERT_TRUE(
+        compiled.try_parse(std::vector<std::string_view>{"./program", "-vn", "x"}, args));
+    EXPECT_EQ(args.get<bool>(verbose_handle), true);
+    EXPECT_FALSE(args.has(text_handle));
+    EXPECT_FALSE(args.get<std::string>(text_handle));
+    EXPECT_THROW(args.get<int>(number_handle), cpparg::util::from_string_error);
+    EXPECT_EQ(args.get<std::string>(number_handle), "x");
+
+    auto validated = parser.compile();
+    auto result = validated.try_parse(std::vector<std::string_view>{"./program", "-n", "x"}, args);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::invalid_argument);
+    EXPECT_EQ(number, 0);
+    EXPECT_FALSE(verbose);
+
+    /* handles are tied to the compiled_parser they come from, which may be moved */
+    EXPECT_THROW(args.has(text_handle), std::logic_error);
+    auto moved = std::move(compiled);
+    ASSERT_TRUE(moved.try_parse(std::vector<std::string_view>{"./program", "--text=c"}, args));
+    EXPECT_EQ(args.value(text_handle), "c");
+}
+
+TEST(parser, response_files) {
+    const std::string nested = testing::TempDir() + "cpparg_nested.rsp";
+    const std::string main = testing::TempDir() + "cpparg_main.rsp";
+    std::ofstream(nested) << "--string 'single quoted \\ text'\n";
+    std::ofstream(main) << "-i 42\n  @" << nested << "\tfree\\ arg \"a \\\"b\\\"\"\n";
+
+    cpparg::parser parser("parser::response_files test");
+    int i = 0;
+    std::string s;
+    std::vector<std::string_view> free_args;
+    parser.add('i', "int").store(i);
+    parser.add('s', "string").store(s);
+    parser.free_arguments("args").unlimited().handle([&free_args](const auto& args) {
+        free_args = args;
+    });
+
+    const std::string main_arg = "@" + main;
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add(main_arg, "last").get();
+    /* disabled by default */
+    auto result = parser.try_parse(argc, argv);
+    ASSERT_TRUE(result);
+    EXPECT_EQ(free_args.front(), main_arg);
+
+    parser.response_files();
+    result = parser.try_parse(argc, argv);
+    ASSERT_TRUE(result) << result.message();
+    EXPECT_EQ(i, 42);
+    EXPECT_EQ(s, "single quoted \\ text");
+    EXPECT_EQ(free_args, (std::vector<std::string_view>{"free arg", "a \"b\"", "last"}));
+
+    const std::string missing = testing::TempDir() + "cpparg_missing.rsp";
+    const std::string missing_arg = "@" + missing;
+    cpparg::test::args_builder missing_builder("./program");
+    std::tie(argc, argv) = missing_builder.add("-i", "1").add(missing_arg).get();
+    result = parser.try_parse(argc, argv);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::response_file_error);
+    EXPECT_EQ(result.token_index(), 3u);
+    EXPECT_EQ(result.message(), "Cannot read response file '" + missing + "'.");
+    EXPECT_THROW(
+        parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow), cpparg::parser_error);
+
+    std::ofstream(main) << "-i x";
+    cpparg::test::args_builder invalid_builder("./program");
+    std::tie(argc, argv) = invalid_builder.add(main_arg).get();
+    result = parser.try_parse(argc, argv);
+    std::remove(main.c_str());
+    std::remove(nested.c_str());
+    /* the mapping outlives the file and the parser state */
+    parser.reset();
+    EXPECT_EQ(result.message(), "Cannot parse option int: invalid value 'x'.");
+}
+
+#if !defined(_WIN32)
+TEST(parser, response_file_pipe) {
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    /* longer than one read() */
+    std::string content(5000, ' ');
+    content += "-i 42 a b c";
+    ASSERT_EQ(::write(fds[1], content.data(), content.size()), ssize_t(content.size()));
+    ::close(fds[1]);
+
+    cpparg::parser parser("parser::response_file_pipe test");
+    parser.response_files();
+    int i = 0;
+    std::vector<std::string_view> free_args;
+    parser.add('i', "int").store(i);
+    parser.free_arguments("args").unlimited().handle([&free_args](const auto& args) {
+        free_args = args;
+    });
+
+    const std::string arg = "@/dev/fd/" + std::to_string(fds[0]);
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add(arg).get();
+    auto result = parser.try_parse(argc, argv);
+    ::close(fds[0]);
+    ASSERT_TRUE(result) << result.message();
+    EXPECT_EQ(i, 42);
+    EXPECT_EQ(free_args, (std::vector<std::string_view>{"a", "b", "c"}));
+}
+#endif
+
+TEST(parser, suggestions) {
+    cpparg::parser parser("parser::suggestions test");
+    parser.positional("input").handle([](auto) { FAIL(); });
+    parser.add('v', "verbose").no_argument().handle([] { FAIL(); });
+    parser.add("version").no_argument().handle([] { FAIL(); });
+    parser.add("output").handle([](auto) { FAIL(); });
+    parser.add("port").handle([](auto) { FAIL(); });
+
+    auto message = [&parser](std::string_view arg) {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add(arg).get();
+        auto result = parser.try_parse(argc, argv);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::unknown_option);
+        return result.message();
+    };
+
+    EXPECT_EQ(message("--verbsoe"), "Unknown option verbsoe. Did you mean --verbose?");
+    EXPECT_EQ(message("--vresion"), "Unknown option vresion. Did you mean --version?");
+    EXPECT_EQ(message("--outptu"), "Unknown option outptu. Did you mean --output?");
+    EXPECT_EQ(message("--prot"), "Unknown option prot. Did you mean --port?");
+    /* a cluster of unknown letters may be a long option given with one dash */
+    EXPECT_EQ(message("-outptu"), "Unknown option o. Did you mean --output?");
+    EXPECT_EQ(message("-x"), "Unknown option x.");
+    /* positional names are not options */
+    EXPECT_EQ(message("--inputs"), "Unknown option inputs.");
+    EXPECT_EQ(message("--quiet"), "Unknown option quiet.");
+
+    auto compiled = parser.compile();
+    cpparg::compiled_parser::arguments args;
+    auto result = compiled.try_parse(std::vector<std::string_view>{"./program", "--prot"}, args);
+    EXPECT_EQ(result.message(), "Unknown option prot. Did you mean --port?");
+    result = compiled.try_parse(std::vector<std::string_view>{"./program", "-outptu"}, args);
+    EXPECT_EQ(result.message(), "Unknown option o. Did you mean --output?");
+}
+
+TEST(parser, abbreviations) {
+    cpparg::parser parser("parser::abbreviations test");
+
+    bool verbose = false;
+    bool version = false;
+    std::vector<int> values;
+    parser.add('v', "verbose").flag(verbose);
+    parser.add("version").flag(version);
+    parser.add("value").repeatable().append(values);
+    parser.add("val").repeatable().append(values);
+
+    auto parse = [&parser](std::vector<std::string> args) {
+        cpparg::test::args_builder builder("./program");
+        for (auto& arg : args) {
+            builder.add(arg);
+        }
+        auto [argc, argv] = builder.get();
+        auto result = parser.try_parse(argc, argv);
+        return result ? std::string{} : result.message();
+    };
+
+    /* off by default, so prefixes stay free for options added later */
+    EXPECT_EQ(parse({"--verb"}), "Unknown option verb.");
+
+    parser.abbreviations();
+    EXPECT_EQ(parse({"--verb", "--versi"}), "");
+    EXPECT_TRUE(verbose && version);
+    /* an exact name wins over the longer names it is a prefix of */
+    EXPECT_EQ(parse({"--val", "1", "--valu=2", "--value", "3"}), "");
+    EXPECT_EQ(values, (std::vector<int>{1, 2, 3}));
+
+    EXPECT_EQ(parse({"--ver"}), "Ambiguous option ver: --verbose, --version.");
+    EXPECT_EQ(parse({"--v"}), "Ambiguous option v: --val, --value, --verbose, --version.");
+    EXPECT_EQ(parse({"--verbose", "--verbo"}), "Option 'verbose' is not repeatable");
+    EXPECT_EQ(parse({"--verbosity"}), "Unknown option verbosity. Did you mean --verbose?");
+
+    auto compiled = parser.compile();
+    cpparg::compiled_parser::arguments args;
+    EXPECT_TRUE(compiled.try_parse(std::vector<std::string_view>{"./program", "--verb"}, args));
+    EXPECT_TRUE(args.has("verbose"));
+    auto result = compiled.try_parse(std::vector<std::string_view>{"./program", "--ver"}, args);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::ambiguous_option);
+    EXPECT_EQ(result.message(), "Ambiguous option ver: --verbose, --version.");
+
+    parser.abbreviations(false);
+    EXPECT_EQ(parse({"--verb"}), "Unknown option verb.");
+}
+
+TEST(parser, prescan) {
+    cpparg::parser parser("parser::prescan test");
+    parser.prescan();
+
+    std::vector<int> ints;
+    std::deque<std::string> strings;
+    bool flag = false;
+    parser.add('i', "int").repeatable().append(ints);
+    parser.add("string").repeatable().append(strings);
+    parser.add('f').flag(flag);
+    parser.free_arguments("free").unlimited();
+
+    cpparg::test::args_builder builder("./program");
+    builder.add("-fi1").add("--int=2").add("--string", "a").add("free").add("-i", "3");
+    builder.add("--").add("-i", "4");
+    auto [argc, argv] = builder.get();
+
+    parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(ints, (std::vector<int>{1, 2, 3}));
+    EXPECT_EQ(ints.capacity(), 3u);
+    EXPECT_EQ(strings, (std::deque<std::string>{"a"}));
+    EXPECT_TRUE(flag);
+
+    /* errors are reported by the parse, not by the prescan */
+    cpparg::test::args_builder unknown("./program");
+    auto [unknown_argc, unknown_argv] = unknown.add("-i", "1").add("--unknown").get();
+    auto result = parser.try_parse(unknown_argc, unknown_argv);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::unknown_option);
+    EXPECT_EQ(result.token_index(), 3u);
+}
+
+TEST(parser, complete) {
+    cpparg::parser parser("parser::complete test");
+    parser.positional("input").handle([](auto) { FAIL(); });
+    parser.add('n', "name").handle([](auto) { FAIL(); });
+    parser.add("number").handle([](auto) { FAIL(); });
+    parser.add('v', "verbose").no_argument().handle([] { FAIL(); });
+
+    auto complete = [&parser](std::vector<std::string_view> words) {
+        std::stringstream out;
+        parser.complete(words, out);
+        return out.str();
+    };
+
+    EXPECT_EQ(complete({"--n"}), "--name\n--number\n");
+    EXPECT_EQ(complete({"input", "-"}), "--name\n--number\n--verbose\n-n\n-v\n");
+    EXPECT_EQ(complete({"--verb"}), "--verbose\n");
+    EXPECT_EQ(complete({"-v"}), "-v\n");
+    EXPECT_EQ(complete({"--"}), "--name\n--number\n--verbose\n");
+    EXPECT_EQ(complete({"--x"}), "");
+    /* values and positional arguments are left to the shell */
+    EXPECT_EQ(complete({"--name", "-"}), "");
+    EXPECT_EQ(complete({"-v", "--num"}), "--number\n");
+    EXPECT_EQ(complete({"in"}), "");
+    EXPECT_EQ(complete({}), "");
+
+    /* options added later are completed as well */
+    parser.add("nice").no_argument().handle([] {});
+    EXPECT_EQ(complete({"--ni"}), "--nice\n");
+
+    /* a completion query is an unknown option until completion is enabled */
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("--__complete", "--nu").get();
+    EXPECT_THROW(parser.parse(argc, argv, cpparg::parsing_error_policy::rethrow), cpparg::parser_error);
+    parser.completion();
+    EXPECT_EXIT(parser.parse(argc, argv), testing::ExitedWithCode(0), "");
+
+    const std::string bash = cpparg::completion_script(cpparg::shell::bash, "/usr/bin/my-tool");
+    EXPECT_NE(bash.find("complete -o default -F _cpparg_my_tool my-tool"), std::string::npos);
+    EXPECT_NE(bash.find("--__complete"), std::string::npos);
+    EXPECT_NE(
+        cpparg::completion_script(cpparg::shell::zsh, "my-tool").find("compdef _cpparg_my_tool"),
+        std::string::npos);
+    EXPECT_NE(
+        cpparg::completion_script(cpparg::shell::fish, "my-tool").find("complete -c my-tool"),
+        std::string::npos);
+}
@@ -0,0 +1,140 @@
+#include "args_builder.h"
+
+#include <cpparg/cpparg.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+constexpr cpparg::static_parser SCHEMA{
+    cpparg::option<int>('n', "number").required(),
+    cpparg::option<std::string>("name"),
+    cpparg::option<double>('r'),
+    cpparg::flag('v', "verbose"),
+};
+
+} // namespace
+
+TEST(static_parser, dispatch) {
+    static_assert(SCHEMA.find_long("number") == 0, "");
+    static_assert(SCHEMA.find_long("name") == 1, "");
+    static_assert(SCHEMA.find_long("verbose") == 3, "");
+    static_assert(SCHEMA.find_long("r") == SCHEMA.OPTIONS_COUNT, "");
+    static_assert(SCHEMA.find_long("") == SCHEMA.OPTIONS_COUNT, "");
+    static_assert(SCHEMA.find_short('r') == 2, "");
+    static_assert(SCHEMA.find_short('x') == SCHEMA.OPTIONS_COUNT, "");
+
+    constexpr cpparg::static_parser many{
+        cpparg::option<int>("option0"),  cpparg::option<int>("option1"),
+        cpparg::option<int>("option2"),  cpparg::option<int>("option3"),
+        cpparg::option<int>("option4"),  cpparg::option<int>("option5"),
+        cpparg::option<int>("option6"),  cpparg::option<int>("option7"),
+        cpparg::option<int>("option8"),  cpparg::option<int>("option9"),
+        cpparg::option<int>("option10"), cpparg::option<int>("option11"),
+        cpparg::option<int>("option12"), cpparg::option<int>("option13"),
+        cpparg::option<int>("option14"), cpparg::option<int>("option15"),
+        cpparg::option<int>("option16"), cpparg::option<int>("option17"),
+        cpparg::option<int>("option18"), cpparg::option<int>("option19"),
+    };
+    for (size_t i = 0; i < many.OPTIONS_COUNT; ++i) {
+        EXPECT_EQ(many.find_long("option" + std::to_string(i)), i);
+    }
+    EXPECT_EQ(many.find_long("option20"), many.OPTIONS_COUNT);
+
+    /* the checks of a schema that is not constexpr throw instead */
+    using cpparg::option;
+    EXPECT_THROW(cpparg::static_parser(option<int>("x"), option<int>("x")), std::logic_error);
+    EXPECT_THROW(cpparg::static_parser(option<int>('x'), option<int>('x')), std::logic_error);
+    EXPECT_THROW(cpparg::static_parser(option<int>("-x")), std::logic_error);
+    EXPECT_NO_THROW(cpparg::static_parser(option<int>('x', "y"), option<int>('y', "x")));
+}
+
+TEST(static_parser, parse) {
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("-n", "42")
+                            .add("--name", "cpparg")
+                            .add("-v")
+                            .add("free")
+                            .add("--")
+                            .add("-r")
+                            .get();
+
+    auto values = SCHEMA.parse(argc, argv);
+    EXPECT_EQ(values.get<0>(), 42);
+    EXPECT_EQ(values.get<1>(), "cpparg");
+    EXPECT_FALSE(values.get<2>());
+    EXPECT_EQ(values.get<3>(), true);
+    EXPECT_EQ(values.free_args, (std::vector<std::string_view>{"free", "-r"}));
+}
+
+TEST(static_parser, option_forms) {
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("-vn-3").add("--name=x=y").add("-r", "-.25").add("-1").get();
+
+    auto values = SCHEMA.parse(argc, argv);
+    EXPECT_EQ(values.get<0>(), -3);
+    EXPECT_EQ(values.get<1>(), "x=y");
+    EXPECT_EQ(values.get<2>(), -0.25);
+    EXPECT_EQ(values.get<3>(), true);
+    EXPECT_EQ(values.free_args, (std::vector<std::string_view>{"-1"}));
+
+    cpparg::test::args_builder flag_value("./program");
+    auto [flag_argc, flag_argv] = flag_value.add("-n1", "--verbose=no").get();
+    decltype(SCHEMA)::values result_values;
+    auto result = SCHEMA.try_parse(flag_argc, flag_argv, result_values);
+    EXPECT_EQ(result.message(), "Cannot parse option verbose: invalid value 'no'.");
+}
+
+TEST(static_parser, try_parse) {
+    decltype(SCHEMA)::values values;
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("-n", "1").add("--unknown").get();
+        auto result = SCHEMA.try_parse(argc, argv, values);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::unknown_option);
+        EXPECT_EQ(result.token_index(), 3u);
+        EXPECT_EQ(result.message(), "Unknown option unknown.");
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("--nmae", "x").get();
+        auto result = SCHEMA.try_parse(argc, argv, values);
+        EXPECT_EQ(result.message(), "Unknown option nmae. Did you mean --name?");
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("-xerbose").get();
+        auto result = SCHEMA.try_parse(argc, argv, values);
+        EXPECT_EQ(result.message(), "Unknown option x. Did you mean --verbose?");
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("--number", "abc").get();
+        auto result = SCHEMA.try_parse(argc, argv, values);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::invalid_argument);
+        EXPECT_EQ(result.token_index(), 2u);
+        EXPECT_EQ(result.message(), "Cannot parse option number: invalid value 'abc'.");
+        EXPECT_THROW(SCHEMA.parse(argc, argv), cpparg::processor_error);
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("-n", "1").add("-r").get();
+        auto result = SCHEMA.try_parse(argc, argv, values);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::argument_required);
+        EXPECT_EQ(result.message(), "Cannot parse option r: argument required.");
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("-n", "1").add("--number", "2").get();
+        auto result = SCHEMA.try_parse(argc, argv, values);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::not_repeatable);
+        EXPECT_EQ(result.token_index(), 3u);
+    }
+    {
+        cpparg::test::args_builder builder("./program");
+        auto [argc, argv] = builder.add("-v").get();
+        auto result = SCHEMA.try_parse(argc, argv, values);
+        EXPECT_EQ(result.error(), cpparg::parse_errc::required_missing);
+        EXPECT_EQ(result.source(), nullptr);
+        EXPECT_EQ(result.message(), "Option number is required.");
+    }
+}
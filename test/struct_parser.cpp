@@ -0,0 +1,188 @@
+#include "args_builder.h"
+
+#include <cpparg/cpparg.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+struct config {
+    int port = 80;
+    std::string host;
+    double ratio = 0.5;
+    bool verbose = false;
+    bool dry_run = false;
+    std::optional<int> limit;
+    std::vector<int> shards;
+    std::vector<std::string> files;
+};
+
+const cpparg::struct_parser SCHEMA{
+    cpparg::field(&config::port, 'p', "port"),
+    cpparg::field(&config::host, "host").required(),
+    cpparg::field(&config::ratio, 'r'),
+    cpparg::field(&config::verbose, 'v', "verbose"),
+    cpparg::field(&config::dry_run, 'n', "dry-run"),
+    cpparg::field(&config::limit, "limit"),
+    cpparg::field(&config::shards, 's', "shard"),
+    cpparg::free_args(&config::files),
+};
+
+} // namespace
+
+TEST(struct_parser, parse) {
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("--host", "localhost")
+                            .add("-vns1")
+                            .add("--shard=2")
+                            .add("--limit", "-3")
+                            .add("input")
+                            .add("-r", "0.25")
+                            .add("--")
+                            .add("--port")
+                            .get();
+
+    const config cfg = SCHEMA.parse(argc, argv);
+    EXPECT_EQ(cfg.port, 80);
+    EXPECT_EQ(cfg.host, "localhost");
+    EXPECT_DOUBLE_EQ(cfg.ratio, 0.25);
+    EXPECT_TRUE(cfg.verbose);
+    EXPECT_TRUE(cfg.dry_run);
+    EXPECT_EQ(cfg.limit, -3);
+    EXPECT_EQ(cfg.shards, (std::vector<int>{1, 2}));
+    EXPECT_EQ(cfg.files, (std::vector<std::string>{"input", "--port"}));
+}
+
+TEST(struct_parser, vector_initializers) {
+    struct defaults {
+        std::vector<int> shards{1};
+        std::vector<std::string> files{"default"};
+    };
+    const cpparg::struct_parser schema{
+        cpparg::field(&defaults::shards, "shard"),
+        cpparg::free_args(&defaults::files),
+    };
+
+    cpparg::test::args_builder given("./program");
+    auto [argc, argv] = given.add("--shard", "2").add("--shard", "3").add("input").get();
+    const defaults parsed = schema.parse(argc, argv);
+    EXPECT_EQ(parsed.shards, (std::vector<int>{2, 3}));
+    EXPECT_EQ(parsed.files, (std::vector<std::string>{"input"}));
+
+    cpparg::test::args_builder empty("./program");
+    auto [empty_argc, empty_argv] = empty.get();
+    const defaults kept = schema.parse(empty_argc, empty_argv);
+    EXPECT_EQ(kept.shards, (std::vector<int>{1}));
+    EXPECT_EQ(kept.files, (std::vector<std::string>{"default"}));
+}
+
+TEST(struct_parser, try_parse) {
+    auto parse = [](std::vector<std::string> args) {
+        cpparg::test::args_builder builder("./program");
+        builder.add("--host", "h");
+        for (auto& arg : args) {
+            builder.add(arg);
+        }
+        auto [argc, argv] = builder.get();
+        config cfg;
+        auto result = SCHEMA.try_parse(argc, argv, cfg);
+        return result ? std::string{} : result.message();
+    };
+
+    EXPECT_EQ(parse({"-p", "8080"}), "");
+    EXPECT_EQ(parse({"--port", "x"}), "Cannot parse option port: invalid value 'x'.");
+    EXPECT_EQ(parse({"-p", "1", "--port", "2"}), "Option 'port' is not repeatable");
+    EXPECT_EQ(parse({"--verbose=1"}), "Cannot parse option verbose: invalid value '1'.");
+    EXPECT_EQ(parse({"--limit"}), "Cannot parse option limit: argument required.");
+    EXPECT_EQ(parse({"--unknown"}), "Unknown option unknown.");
+    EXPECT_EQ(parse({"--prot", "1"}), "Unknown option prot. Did you mean --port?");
+    EXPECT_EQ(parse({"-hsot", "h"}), "Unknown option h. Did you mean --host?");
+    EXPECT_EQ(parse({"--d"}), "Unknown option d.");
+    EXPECT_EQ(parse({"-x"}), "Unknown option x.");
+
+    cpparg::test::args_builder missing("./program");
+    auto [argc, argv] = missing.add("-p", "1").get();
+    config cfg;
+    auto result = SCHEMA.try_parse(argc, argv, cfg);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::required_missing);
+    EXPECT_EQ(result.message(), "Option host is required.");
+    EXPECT_EQ(cfg.port, 1);
+    EXPECT_THROW(SCHEMA.parse(argc, argv), cpparg::processor_error);
+
+    const cpparg::struct_parser no_free_args{cpparg::field(&config::port, "port")};
+    cpparg::test::args_builder free("./program");
+    auto [free_argc, free_argv] = free.add("a").add("b").get();
+    result = no_free_args.try_parse(free_argc, free_argv, cfg);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::too_many_free_arguments);
+    EXPECT_EQ(result.message(), "Invalid free arguments count, got 2 while maximum is 0");
+
+    EXPECT_THROW(
+        cpparg::struct_parser(
+            cpparg::field(&config::port, "x"), cpparg::field(&config::ratio, "x")),
+        std::logic_error);
+    EXPECT_THROW(
+        cpparg::struct_parser(
+            cpparg::field(&config::port, 'x'), cpparg::field(&config::ratio, 'x')),
+        std::logic_error);
+}
+
+TEST(struct_parser, help) {
+    cpparg::struct_parser schema{
+        cpparg::field(&config::port, 'p', "port").description("Port to listen on"),
+        cpparg::field(&config::host, "host").required().description("Host name"),
+        cpparg::field(&config::shards, "shard").description("Shard to serve"),
+        cpparg::free_args(&config::files),
+    };
+    schema.title("Server").add_help('h', "help");
+    EXPECT_THROW(schema.add_help('x', "other-help"), std::logic_error);
+    EXPECT_THROW(schema.add_help('p'), std::logic_error);
+
+    EXPECT_EQ(
+        schema.help_message(),
+        "Server\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help     Print this help and exit\n"
+        "  -p, --port     Port to listen on\n"
+        "  --host         Host name (required)\n"
+        "  --shard        Shard to serve (repeatable)\n");
+    EXPECT_TRUE(cpparg::util::starts_with(
+        schema.help_message("Option host is required."), "Option host is required.\n"));
+
+    config cfg;
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("--po", "8080").add("--host", "h").get();
+    auto result = schema.try_parse(argc, argv, cfg);
+    EXPECT_EQ(result.error(), cpparg::parse_errc::unknown_option);
+
+    schema.abbreviations();
+    ASSERT_TRUE(schema.try_parse(argc, argv, cfg));
+    EXPECT_EQ(cfg.port, 8080);
+
+    cpparg::test::args_builder help("./program");
+    auto [help_argc, help_argv] = help.add("--help").add("--port", "x").get();
+    result = schema.try_parse(help_argc, help_argv, cfg);
+    EXPECT_TRUE(result);
+    EXPECT_TRUE(result.help_requested());
+    EXPECT_EXIT(
+        schema.parse(help_argc, help_argv), testing::ExitedWithCode(0), "Port to listen on");
+}
+
+TEST(struct_parser, not_standard_layout) {
+    /* the members are reached through member pointers, not offsets */
+    struct settings {
+        virtual ~settings() = default;
+        int port = 80;
+        std::string host;
+    };
+    static_assert(!std::is_standard_layout_v<settings>);
+    const cpparg::struct_parser schema{
+        cpparg::field(&settings::port, 'p', "port"),
+        cpparg::field(&settings::host, "host"),
+    };
+
+    cpparg::test::args_builder builder("./program");
+    auto [argc, argv] = builder.add("--host", "h").add("-p", "8080").get();
+    const settings parsed = schema.parse(argc, argv);
+    EXPECT_EQ(parsed.port, 8080);
+    EXPECT_EQ(parsed.host, "h");
+}
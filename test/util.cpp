@@ -1,6 +1,11 @@
 #include <cpparg/cpparg.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <memory>
+
 namespace su = cpparg::util;
 
 TEST(util, join) {
@@ -38,6 +43,33 @@ TEST(util, to_string) {
     EXPECT_EQ("15 3.14 name", su::to_string(dummy{15, 3.14, "name"}));
 }
 
+/* Leaves its format on the stream when asked to, as careless operator<< do */
+struct sticky_format {
+    double d;
+    std::string s;
+    bool sticky;
+};
+std::ostream& operator<<(std::ostream& os, const sticky_format& obj) {
+    if (obj.sticky) {
+        os << std::setprecision(2) << std::setfill('*');
+    }
+    os << obj.d;
+    return obj.sticky ? os << std::setw(8) : os;
+}
+std::istream& operator>>(std::istream& is, sticky_format& obj) {
+    is >> obj.d;
+    return obj.sticky ? is >> std::setw(2) : is >> obj.s;
+}
+TEST(util, to_string_resets_format) {
+    EXPECT_EQ("3.1", su::to_string(sticky_format{3.14159, "", true}));
+    EXPECT_EQ("3.14159", su::to_string(sticky_format{3.14159, "", false}));
+    sticky_format in{0, "", true};
+    EXPECT_TRUE(su::try_from_string("2.5", in));
+    in.sticky = false;
+    EXPECT_TRUE(su::try_from_string("2.5 longer", in));
+    EXPECT_EQ("longer", in.s);
+}
+
 TEST(util, from_string) {
     EXPECT_EQ(1, su::from_string<short>("1"));
     EXPECT_EQ("abc", su::from_string<std::string>("abc"));
@@ -49,6 +81,43 @@ TEST(util, from_string) {
     EXPECT_EQ((dummy{15, 3.14, "name"}), su::from_string<dummy>("15 3.14 name"));
 }
 
+TEST(util, from_string_charconv) {
+    EXPECT_EQ(42, su::from_string<int>("+42"));
+    EXPECT_EQ(42, su::from_string<int>("  42"));
+    EXPECT_EQ(
+        std::numeric_limits<long long>::min(),
+        su::from_string<long long>("-9223372036854775808"));
+    EXPECT_EQ(
+        std::numeric_limits<size_t>::max(),
+        su::from_string<size_t>("18446744073709551615"));
+    EXPECT_EQ(-1.5e10, su::from_string<double>("-1.5e10"));
+    EXPECT_EQ(0.25f, su::from_string<float>("0.25"));
+    EXPECT_EQ(true, su::from_string<bool>("1"));
+    EXPECT_EQ(false, su::from_string<bool>("0"));
+    EXPECT_EQ('x', su::from_string<unsigned char>(" x"));
+
+    EXPECT_THROW(su::from_string<int>(""), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<int>("12 "), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<int>("12abc"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<int>("+-12"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<short>("32768"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<unsigned>("-1"), cpparg::util::from_string_error);
+    EXPECT_THROW(
+        su::from_string<size_t>("18446744073709551616"),
+        cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<double>("1.5.3"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<double>("1e100000"), cpparg::util::from_string_error);
+    /* non-finite spellings are rejected, as by std::istream */
+    EXPECT_THROW(su::from_string<double>("inf"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<double>("-infinity"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<float>("nan"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<double>("+NaN"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<bool>("2"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<bool>("true"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<char>("ab"), cpparg::util::from_string_error);
+    EXPECT_THROW(su::from_string<char>("  "), cpparg::util::from_string_error);
+}
+
 TEST(util, from_string_to_string) {
     EXPECT_EQ(false, su::from_string<bool>(su::to_string(false)));
     EXPECT_EQ(true, su::from_string<bool>(su::to_string(true)));
@@ -89,3 +158,184 @@ TEST(util, is_convertible_from_string) {
     static_assert(!cpparg::util::detail::is_convertible_from_string_v<std::pair<int, int>>, "");
     static_assert(!cpparg::util::detail::is_convertible_from_string_v<void>, "");
 }
+
+TEST(util, name_table) {
+    cpparg::detail::name_table<int> table;
+    std::vector<std::string> names;
+    for (int i = 0; i < 1000; ++i) {
+        names.push_back("name" + std::to_string(i));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(table.insert(names[i], i));
+    }
+    EXPECT_FALSE(table.insert("name0", -1));
+    EXPECT_TRUE(table.insert("", -1));
+    EXPECT_EQ(table.size(), 1001u);
+
+    for (int i = 0; i < 1000; ++i) {
+        const int* found = table.find(names[i]);
+        ASSERT_NE(found, nullptr);
+        EXPECT_EQ(*found, i);
+    }
+    EXPECT_EQ(*table.find(""), -1);
+    EXPECT_EQ(table.find("name1000"), nullptr);
+    EXPECT_EQ(table.find("name"), nullptr);
+}
+
+TEST(util, inline_function) {
+    using function = cpparg::detail::inline_function<int(int)>;
+
+    int calls = 0;
+    function small = [&calls](int x) {
+        ++calls;
+        return x + 1;
+    };
+    std::array<int, 64> big_state{};
+    big_state[0] = 100;
+    function big = [big_state, &calls](int x) {
+        ++calls;
+        return x + big_state[0];
+    };
+    auto shared = std::make_shared<int>(5);
+    function owning = [shared](int x) { return x * *shared; };
+
+    EXPECT_EQ(small(1), 2);
+    EXPECT_EQ(big(1), 101);
+    EXPECT_EQ(owning(2), 10);
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(shared.use_count(), 2);
+
+    function moved = std::move(small);
+    EXPECT_FALSE(small);
+    EXPECT_EQ(moved(2), 3);
+
+    moved = std::move(big);
+    EXPECT_EQ(moved(2), 102);
+
+    function empty;
+    EXPECT_FALSE(empty);
+    empty = std::move(owning);
+    EXPECT_EQ(empty(3), 15);
+    empty = function{};
+    EXPECT_EQ(shared.use_count(), 1);
+}
+
+TEST(util, string_arena) {
+    cpparg::detail::string_arena arena;
+    std::vector<std::string_view> views;
+    for (int i = 0; i < 10000; ++i) {
+        views.push_back(arena.intern(std::to_string(i)));
+    }
+    std::string large(10000, 'x');
+    std::string_view large_view = arena.intern(large);
+
+    for (int i = 0; i < 10000; ++i) {
+        EXPECT_EQ(views[i], std::to_string(i));
+    }
+    EXPECT_EQ(large_view, large);
+    EXPECT_TRUE(arena.intern("").empty());
+}
+
+TEST(util, stable_storage) {
+    cpparg::detail::stable_storage<std::string, 4> storage;
+    std::vector<const std::string*> addresses;
+    for (int i = 0; i < 100; ++i) {
+        addresses.push_back(&storage.emplace_back(std::to_string(i)));
+    }
+
+    auto moved = std::move(storage);
+    EXPECT_TRUE(storage.empty());
+    ASSERT_EQ(moved.size(), 100u);
+    for (size_t i = 0; i < moved.size(); ++i) {
+        EXPECT_EQ(&moved[i], addresses[i]);
+        EXPECT_EQ(moved[i], std::to_string(i));
+    }
+}
+
+TEST(util, edit_distance) {
+    /* optimal string alignment: Levenshtein with swaps of adjacent characters */
+    auto naive = [](std::string_view a, std::string_view b) {
+        std::vector<std::vector<size_t>> d(a.size() + 1, std::vector<size_t>(b.size() + 1));
+        for (size_t i = 0; i <= a.size(); ++i) {
+            d[i][0] = i;
+        }
+        for (size_t j = 0; j <= b.size(); ++j) {
+            d[0][j] = j;
+        }
+        for (size_t i = 1; i <= a.size(); ++i) {
+            for (size_t j = 1; j <= b.size(); ++j) {
+                d[i][j] = std::min(
+                    {d[i - 1][j] + 1, d[i][j - 1] + 1, d[i - 1][j - 1] + (a[i - 1] != b[j - 1])});
+                if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1]) {
+                    d[i][j] = std::min(d[i][j], d[i - 2][j - 2] + 1);
+                }
+            }
+        }
+        return d[a.size()][b.size()];
+    };
+
+    const std::vector<std::string_view> words = {
+        "", "a", "ab", "ba", "abc", "ca", "prot", "port", "verbose", "verbos", "vrebose", "version", "verbose-level",
+        "kitten", "sitting", std::string_view("0123456789012345678901234567890123456789"
+                                              "0123456789012345678901234", 64),
+        "1123456789012345678901234567890123456789012345678901234567890124"};
+    for (auto pattern : words) {
+        cpparg::detail::edit_distance distance(pattern);
+        for (auto text : words) {
+            const size_t expected = naive(pattern, text);
+            EXPECT_EQ(distance(text, 100), expected) << pattern << " -> " << text;
+            for (size_t limit = 0; limit < 5; ++limit) {
+                EXPECT_EQ(distance(text, limit), std::min(expected, limit + 1));
+            }
+        }
+    }
+
+    cpparg::detail::edit_distance typo("verbsoe");
+    EXPECT_EQ(typo.closest(std::vector<std::string_view>{"version", "verbose", "verb"}), "verbose");
+    EXPECT_EQ(typo.closest(std::vector<std::string_view>{"quiet", "help"}), "");
+    /* a swap is a single edit */
+    EXPECT_EQ(cpparg::detail::edit_distance("prot")("port", 5), 1u);
+    EXPECT_EQ(
+        cpparg::detail::edit_distance("prot").closest(std::vector<std::string_view>{"port"}),
+        "port");
+}
+
+TEST(util, command_line) {
+    using args = std::vector<std::string_view>;
+
+    cpparg::command_line line;
+    EXPECT_EQ(line.argc(), 0);
+    EXPECT_EQ(line.argv()[0], nullptr);
+
+    EXPECT_EQ(
+        line.split("  ./program  -a\t--bb\nccc  ").args(),
+        (args{"./program", "-a", "--bb", "ccc"}));
+    EXPECT_EQ(
+        line.split("'single \"quoted\" \\ text'").args(), (args{"single \"quoted\" \\ text"}));
+    EXPECT_EQ(line.split("\"a \\\"b\\\" \\$ \\x\"").args(), (args{"a \"b\" $ \\x"}));
+    EXPECT_EQ(line.split("a\\ b c\\\nd \\'e").args(), (args{"a b", "cd", "'e"}));
+    EXPECT_EQ(line.split("pre'fix'\"ed\" '' \"\"").args(), (args{"prefixed", "", ""}));
+    EXPECT_EQ(line.split("").argc(), 0);
+    EXPECT_THROW(line.split("'unterminated"), cpparg::parser_error);
+    EXPECT_THROW(line.split("\"unterminated\\\""), cpparg::parser_error);
+
+    /* long runs go through the vectorized scan */
+    std::string long_arg(100, 'x');
+    std::string quoted = "\"" + long_arg + "\\\"" + long_arg + "\"";
+    line.split(long_arg + "   " + quoted + " " + long_arg + "\\ " + long_arg);
+    EXPECT_EQ(
+        line.args(), (args{long_arg, long_arg + '"' + long_arg, long_arg + ' ' + long_arg}));
+
+    cpparg::parser parser("util::command_line test");
+    std::string name;
+    int count = 0;
+    parser.add('n', "name").store(name);
+    parser.add('c', "count").store(count);
+    line.split("./program --name 'John Smith' -c 3");
+    cpparg::command_line moved = std::move(line);
+    parser.parse(moved.argc(), moved.argv(), cpparg::parsing_error_policy::rethrow);
+    EXPECT_EQ(name, "John Smith");
+    EXPECT_EQ(count, 3);
+    EXPECT_EQ(moved.argv()[moved.argc()], nullptr);
+    EXPECT_STREQ(moved.argv()[2], "John Smith");
+}